@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "core/palette.h"
+#include "core/pixel_kernels.h"
+
+// Checks every SIMD kernel supported by this CPU against the scalar reference on random
+// input, then times a frame's worth (240 lines) of each (line mixing and line hashing),
+// along with the indexed to RGB(A) conversions.
+//
+//   usage: qnes_bench_pixel_kernels [frames]
+
+static const int LINES = 240;
+
+int main(int argc, char **argv)
+{
+  const int frames = argc > 1 ? atoi(argv[1]) : 1000;
+
+  std::mt19937 rng(1234);
+  const auto random_byte = [&]() -> u8 { return rng() & 0xFF; };
+
+  // Inputs in the ranges the PPU produces. Sprite pixels are either transparent or have
+  // bit 4 set, plus random priority and sprite-0 bits.
+  std::vector<u8> bg(256 * LINES), sprite(256 * LINES);
+  for (int i = 0; i < 256 * LINES; ++i)
+  {
+    bg[i] = random_byte() & 0x0F;
+    const u8 s = random_byte();
+    sprite[i] = (s & 3) ? (0x10 | (s & 0x6F)) : 0;
+  }
+
+  LinePalette palette;
+  for (int i = 0; i < 32; ++i)
+    palette.colors[i] = random_byte() & 0x3F;
+  palette.emphasis = 5 << 6;
+
+  std::vector<u16> reference(256 * LINES), output(256 * LINES);
+  for (int line = 0; line < LINES; ++line)
+    MixLineScalar(&bg[256 * line], &sprite[256 * line], palette, &reference[256 * line]);
+
+  const SIMDLevel best = DetectSIMDLevel();
+  printf("best supported: %s\n", SIMDLevelName(best));
+
+  using clock = std::chrono::steady_clock;
+  bool all_match = true;
+
+  for (int level = (int)SIMDLevel::Scalar; level <= (int)best; ++level)
+  {
+    const MixLineFn mix_line = GetMixLineKernel((SIMDLevel)level);
+
+    std::fill(output.begin(), output.end(), 0);
+    for (int line = 0; line < LINES; ++line)
+      mix_line(&bg[256 * line], &sprite[256 * line], palette, &output[256 * line]);
+    const bool match = output == reference;
+    all_match = all_match && match;
+
+    const auto start = clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+      for (int line = 0; line < LINES; ++line)
+        mix_line(&bg[256 * line], &sprite[256 * line], palette, &output[256 * line]);
+    const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+
+    printf("  line mix %-6s  %8.3f us/frame  %s\n", SIMDLevelName((SIMDLevel)level), us / frames,
+           match ? "matches scalar" : "MISMATCH");
+  }
+
+  // Line hashes, over the mixed lines
+  std::vector<u64> reference_hashes(LINES), hashes(LINES);
+  for (int line = 0; line < LINES; ++line)
+    reference_hashes[line] = HashLineScalar(&reference[256 * line]);
+
+  for (int level = (int)SIMDLevel::Scalar; level <= (int)best; ++level)
+  {
+    const HashLineFn hash_line = GetHashLineKernel((SIMDLevel)level);
+
+    for (int line = 0; line < LINES; ++line)
+      hashes[line] = hash_line(&reference[256 * line]);
+    const bool match = hashes == reference_hashes;
+    all_match = all_match && match;
+
+    u64 sink = 0;
+    const auto start = clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+      for (int line = 0; line < LINES; ++line)
+        sink += hash_line(&reference[256 * line]);
+    const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+
+    printf("  line hash %-6s %8.3f us/frame  %s%s\n", SIMDLevelName((SIMDLevel)level), us / frames,
+           match ? "matches scalar" : "MISMATCH", sink == 0 ? " " : "");
+  }
+
+  std::vector<u8> converted(4 * 256 * LINES);
+  const auto time_conversion = [&](const char *name, void (*convert)(const u16 *, u8 *, int)) {
+    const auto start = clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+      convert(reference.data(), converted.data(), 256 * LINES);
+    const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    printf("  %-15s %8.3f us/frame\n", name, us / frames);
+  };
+  time_conversion("indexed to RGB", ConvertIndexedToRGB);
+  time_conversion("indexed to RGBA", ConvertIndexedToRGBA);
+
+  return all_match ? 0 : 1;
+}
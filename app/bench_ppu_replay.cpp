@@ -0,0 +1,157 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+#include "core/console.h"
+
+// Runs a ROM in each PPU render mode, checks that the deferred and threaded modes produce
+// exactly the same frames as synchronous rendering, and times them. Then checks that
+// deferred rendering stays in constant memory over frames nobody waits for: ones drawn by
+// the accurate backend, and skipped ones.
+//
+//   usage: qnes_bench_ppu_replay [rom-file-path] [frames]
+
+static const int WIDTH = 256;
+static const int HEIGHT = 240;
+
+// FNV-1a over one indexed frame
+static u64 hash_frame(const u16 *pixels)
+{
+  u64 hash = 14695981039346656037ull;
+  for (int i = 0; i < WIDTH * HEIGHT; ++i)
+  {
+    hash = (hash ^ (pixels[i] & 0xFF)) * 1099511628211ull;
+    hash = (hash ^ (pixels[i] >> 8)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Resident memory in KB, or -1 where /proc is not there to say.
+static long resident_kb()
+{
+  FILE *file = fopen("/proc/self/statm", "r");
+  if (!file)
+    return -1;
+
+  long total_pages, resident_pages;
+  const bool read = fscanf(file, "%ld %ld", &total_pages, &resident_pages) == 2;
+  fclose(file);
+  return read ? resident_pages * (sysconf(_SC_PAGESIZE) / 1024) : -1;
+}
+
+static std::shared_ptr<Console> load_console(const char *rom_path)
+{
+  std::shared_ptr<Console> console = std::make_shared<Console>();
+  RomLoadError error = console->LoadROM(rom_path);
+  if (error != RomLoadError::None)
+  {
+    printf("Could not load rom file '%s': %s.\n", rom_path, GetRomLoadErrorString(error));
+    exit(1);
+  }
+  console->HardReset();
+  return console;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: %s [rom-file-path] [frames]\n", argv[0]);
+    exit(1);
+  }
+
+  const char *rom_path = argv[1];
+  const int frames = argc > 2 ? atoi(argv[2]) : 1000;
+
+  using clock = std::chrono::steady_clock;
+  const struct
+  {
+    PPURenderMode mode;
+    const char *name;
+  } modes[] = {
+      {PPURenderMode::Synchronous, "synchronous"},
+      {PPURenderMode::Deferred, "deferred"},
+      {PPURenderMode::Threaded, "threaded"},
+  };
+
+  std::vector<u64> reference;
+  bool all_match = true;
+
+  for (const auto &mode : modes)
+  {
+    std::shared_ptr<Console> console = load_console(rom_path);
+    console->GetPPU()->SetRenderMode(mode.mode);
+
+    std::vector<u64> hashes;
+    hashes.reserve(frames);
+
+    const auto start = clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+      console->StepFrame();
+      hashes.push_back(hash_frame(console->GetIndexedFrameBuffer()));
+    }
+    const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+    if (reference.empty())
+      reference = hashes;
+
+    int first_mismatch = -1;
+    for (int frame = 0; frame < frames && first_mismatch < 0; ++frame)
+      if (hashes[frame] != reference[frame])
+        first_mismatch = frame;
+    all_match = all_match && first_mismatch < 0;
+
+    printf("  %-12s %8.3f ms/frame  ", mode.name, ms / frames);
+    if (first_mismatch < 0)
+      printf("matches synchronous\n");
+    else
+      printf("MISMATCH from frame %d\n", first_mismatch);
+  }
+
+  // Deferred mode only replays its log when a frame is waited for; these frames are not.
+  const struct
+  {
+    PPUBackend backend;
+    bool skip_output;
+    const char *name;
+  } unwaited[] = {
+      {PPUBackend::Accurate, false, "accurate"},
+      {PPUBackend::Fast, true, "frameskip"},
+  };
+
+  bool all_flat = true;
+  for (const auto &test : unwaited)
+  {
+    std::shared_ptr<Console> console = load_console(rom_path);
+    console->GetPPU()->SetRenderMode(PPURenderMode::Deferred);
+    console->GetPPU()->SetBackend(test.backend);
+    console->GetPPU()->SetSkipFrameOutput(test.skip_output);
+
+    // Measured from a quarter of the way in, once everything has been touched.
+    long start_kb = -1;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+      if (frame == frames / 4)
+        start_kb = resident_kb();
+      console->StepFrame();
+    }
+
+    const long growth_kb = resident_kb() - start_kb;
+    if (start_kb < 0)
+    {
+      printf("  deferred, %-10s memory use unknown\n", test.name);
+      continue;
+    }
+
+    // A log left to grow is tens of KB per frame.
+    const bool flat = growth_kb < 1024;
+    all_flat = all_flat && flat;
+    printf("  deferred, %-10s %+6ld KB over %d frames  %s\n", test.name, growth_kb, frames - frames / 4,
+           flat ? "flat" : "GROWING");
+  }
+
+  return all_match && all_flat ? 0 : 1;
+}
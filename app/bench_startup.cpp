@@ -0,0 +1,70 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include "core/console.h"
+
+// Measures how long it takes to spin up many independent consoles, e.g. for running
+// thousands of environments side by side.
+//
+//   usage: qnes_bench_startup [rom-file-path] [count]
+
+// What one console may take to construct, load and reset, all told: 10k of them in 200ms.
+static const double BUDGET_US = 20.0;
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: %s [rom-file-path] [count]\n", argv[0]);
+    exit(1);
+  }
+
+  const char *rom_path = argv[1];
+  const int count = argc > 2 ? atoi(argv[2]) : 10000;
+
+  using clock = std::chrono::steady_clock;
+  const auto ms_since = [](clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  };
+
+  std::vector<std::shared_ptr<Console>> consoles;
+  consoles.reserve(count);
+
+  auto start = clock::now();
+  for (int i = 0; i < count; ++i)
+    consoles.push_back(std::make_shared<Console>());
+  const double construct_ms = ms_since(start);
+
+  start = clock::now();
+  for (auto &console : consoles)
+  {
+    RomLoadError error = console->LoadROM(rom_path);
+    if (error != RomLoadError::None)
+    {
+      printf("Could not load rom file '%s': %s.\n", rom_path, GetRomLoadErrorString(error));
+      exit(1);
+    }
+  }
+  const double load_ms = ms_since(start);
+
+  start = clock::now();
+  for (auto &console : consoles)
+    console->HardReset();
+  const double reset_ms = ms_since(start);
+
+  start = clock::now();
+  consoles.clear();
+  const double destroy_ms = ms_since(start);
+
+  printf("%d consoles\n", count);
+  printf("  construct  %10.3f ms  (%8.3f us each)\n", construct_ms, 1000.0 * construct_ms / count);
+  printf("  load rom   %10.3f ms  (%8.3f us each)\n", load_ms, 1000.0 * load_ms / count);
+  printf("  reset      %10.3f ms  (%8.3f us each)\n", reset_ms, 1000.0 * reset_ms / count);
+  printf("  destroy    %10.3f ms  (%8.3f us each)\n", destroy_ms, 1000.0 * destroy_ms / count);
+
+  const double startup_us = 1000.0 * (construct_ms + load_ms + reset_ms) / count;
+  printf("  startup    %10.3f us each, budget %.3f us: %s\n", startup_us, BUDGET_US, startup_us <= BUDGET_US ? "ok" : "OVER BUDGET");
+  return 0;
+}
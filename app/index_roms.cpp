@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "core/cartridge.h"
+#include "core/content_hash.h"
+#include "core/mapped_file.h"
+#include "core/ppu.h"
+#include "core/rom_index.h"
+
+// Scans a directory tree for .nes files on all cores, and writes an index of them (see
+// core/rom_index.h): content hashes, header details, and per-ROM overrides.
+//
+//   usage: qnes_index_roms [rom-directory] [index-file] [overrides-file]
+//
+// The overrides file has one ROM per line, by the CRC-32 of its PRG-ROM and CHR-ROM:
+//
+//   # Mid-frame scroll effects
+//   3f8d21c4 backend=accurate
+
+struct ScannedRom
+{
+  bool indexed;
+  RomLoadError error;
+  RomIndexEntry entry;
+};
+
+static bool has_nes_extension(const std::filesystem::path &path)
+{
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+  return extension == ".nes";
+}
+
+static void scan_rom(const std::string &path, ScannedRom &rom)
+{
+  rom.indexed = false;
+
+  std::shared_ptr<const u8> data;
+  size_t size;
+  if (!MapFile(path.c_str(), data, size))
+  {
+    rom.error = RomLoadError::CannotOpen;
+    return;
+  }
+
+  CartridgeDescription description;
+  RomLayout layout;
+  rom.error = Cartridge::ParseHeader(data.get(), size, description, layout);
+  if (rom.error != RomLoadError::None)
+    return;
+
+  RomIndexEntry &entry = rom.entry;
+  memset(&entry, 0, sizeof(entry));
+
+  // PRG-ROM and CHR-ROM are back to back in the file.
+  const u8 *contents = data.get() + layout.PRGOffset;
+  entry.CRC32 = RomIndex::ContentCRC32(contents, layout);
+  SHA1(contents, layout.PRGSize, contents + layout.PRGSize, layout.CHRSize, entry.SHA1);
+
+  entry.PRGSize = layout.PRGSize;
+  entry.CHRSize = layout.CHRSize;
+  entry.MapperNumber = description.MapperNumber;
+  entry.SubmapperNumber = description.SubmapperNumber;
+  entry.PPUBackend = ROM_INDEX_NO_OVERRIDE;
+
+  if (Cartridge::IsMapperSupported(description.MapperNumber) && !description.HasTrainer)
+    entry.Flags |= ROM_INDEX_SUPPORTED;
+  if (description.IsNES2)
+    entry.Flags |= ROM_INDEX_NES2;
+  if (description.HasBatteryBackedRAM)
+    entry.Flags |= ROM_INDEX_BATTERY;
+  if (description.HasTrainer)
+    entry.Flags |= ROM_INDEX_TRAINER;
+  if (description.HardwiredMirroringModeIsVertical)
+    entry.Flags |= ROM_INDEX_VERTICAL;
+  if (description.IgnoreMirroringControl)
+    entry.Flags |= ROM_INDEX_FOUR_SCREEN;
+
+  rom.indexed = true;
+}
+
+// Returns the number of overrides applied, or -1 if the file cannot be read.
+static int apply_overrides(const char *path, std::vector<RomIndexEntry> &entries)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return -1;
+
+  int applied = 0;
+  char line[256];
+  for (int line_number = 1; fgets(line, sizeof(line), file); ++line_number)
+  {
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+
+    unsigned crc32;
+    char setting[64];
+    int fields = sscanf(line, "%x %63s", &crc32, setting);
+    if (fields == EOF)
+      continue; // Blank
+
+    u8 backend = ROM_INDEX_NO_OVERRIDE;
+    if (fields == 2 && strcmp(setting, "backend=fast") == 0)
+      backend = (u8)PPUBackend::Fast;
+    else if (fields == 2 && strcmp(setting, "backend=accurate") == 0)
+      backend = (u8)PPUBackend::Accurate;
+    else if (fields == 2 && strcmp(setting, "backend=auto") == 0)
+      backend = (u8)PPUBackend::Auto;
+    else
+    {
+      printf("%s:%d: unknown override\n", path, line_number);
+      continue;
+    }
+
+    for (RomIndexEntry &entry : entries)
+      if (entry.CRC32 == crc32)
+      {
+        entry.PPUBackend = backend;
+        applied++;
+      }
+  }
+
+  fclose(file);
+  return applied;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    printf("usage: %s [rom-directory] [index-file] [overrides-file]\n", argv[0]);
+    exit(1);
+  }
+
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+
+  std::vector<std::string> paths;
+  std::error_code error;
+  const auto options = std::filesystem::directory_options::skip_permission_denied;
+  for (std::filesystem::recursive_directory_iterator it(argv[1], options, error), end; !error && it != end; it.increment(error))
+    if (it->is_regular_file(error) && has_nes_extension(it->path()))
+      paths.push_back(it->path().string());
+
+  if (error)
+  {
+    printf("Could not scan '%s': %s\n", argv[1], error.message().c_str());
+    exit(1);
+  }
+  std::sort(paths.begin(), paths.end());
+
+  // Each worker takes the next file until there are none left; the work per file is
+  // mostly hashing, so one thread per core.
+  std::vector<ScannedRom> scanned(paths.size());
+  std::atomic<size_t> next_path(0);
+  const int thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < thread_count; ++i)
+    workers.emplace_back([&]() {
+      for (size_t path = next_path++; path < paths.size(); path = next_path++)
+        scan_rom(paths[path], scanned[path]);
+    });
+  for (std::thread &worker : workers)
+    worker.join();
+
+  std::vector<RomIndexEntry> entries;
+  std::string path_strings;
+  int errors[(int)RomLoadError::UnsupportedMapper + 1] = {};
+  int supported = 0;
+
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    if (!scanned[i].indexed)
+    {
+      errors[(int)scanned[i].error]++;
+      continue;
+    }
+
+    RomIndexEntry entry = scanned[i].entry;
+    entry.PathOffset = path_strings.size();
+    path_strings.append(paths[i]);
+    path_strings.push_back(0);
+    entries.push_back(entry);
+
+    if (entry.Flags & ROM_INDEX_SUPPORTED)
+      supported++;
+  }
+
+  if (argc > 3 && apply_overrides(argv[3], entries) < 0)
+  {
+    printf("Could not read overrides file '%s'\n", argv[3]);
+    exit(1);
+  }
+
+  if (!RomIndex::Write(argv[2], entries, path_strings))
+  {
+    printf("Could not write index file '%s'\n", argv[2]);
+    exit(1);
+  }
+
+  const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  printf("%zu files, %zu indexed (%d supported) in %.1f ms on %d threads\n", paths.size(), entries.size(), supported, ms, thread_count);
+  for (int i = 1; i <= (int)RomLoadError::UnsupportedMapper; ++i)
+    if (errors[i])
+      printf("  skipped %d: %s\n", errors[i], GetRomLoadErrorString((RomLoadError)i));
+  return 0;
+}
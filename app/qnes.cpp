@@ -1,6 +1,15 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include "core/cartridge.h"
 #include "core/console.h"
+#include "core/log.h"
+#include "core/rom_image.h"
+#include "core/rom_index.h"
+#include "core/save_ram.h"
 
 #include "frontend/SDL2GLFrontend.h"
 
@@ -8,14 +17,56 @@ int main(int argc, char **argv)
 {
   if (argc < 2)
   {
-    printf("usage: %s [rom-file-path]", argv[0]);
+    printf("usage: %s [rom-file-path] [fast|accurate|auto]", argv[0]);
     exit(1);
   }
 
+  // PPU backend for this ROM; by default the accurate one is used only where it is needed.
+  PPUBackend backend = PPUBackend::Auto;
+  const bool backend_chosen = argc > 2;
+  if (argc > 2 && strcmp(argv[2], "fast") == 0)
+    backend = PPUBackend::Fast;
+  else if (argc > 2 && strcmp(argv[2], "accurate") == 0)
+    backend = PPUBackend::Accurate;
+
+  // Log messages are written out as they come, away from the emulation thread.
+  Log::StartWriter(stdout);
+
+  // How often battery-backed RAM is written out to its .sav file, in milliseconds.
+  if (const char *flush_interval = getenv("QNES_SAVE_FLUSH_MS"))
+  {
+    char *end;
+    errno = 0;
+    const unsigned long milliseconds = strtoul(flush_interval, &end, 10);
+    if (!isdigit((unsigned char)flush_interval[0]) || *end != 0 || errno == ERANGE || milliseconds > UINT32_MAX)
+      printf("Ignoring QNES_SAVE_FLUSH_MS='%s': not a number of milliseconds.\n", flush_interval);
+    else
+      SaveRAM::SetFlushInterval(milliseconds);
+  }
+
   std::shared_ptr<Console> console = std::make_shared<Console>();
-  console->LoadROM(argv[1]);
+  RomLoadError error = console->LoadROM(argv[1]);
+  if (error != RomLoadError::None)
+  {
+    printf("Could not load rom file '%s': %s.\n", argv[1], GetRomLoadErrorString(error));
+    exit(1);
+  }
   console->HardReset();
 
+  // Settings for this ROM from a library index (see qnes_index_roms), unless given above.
+  const char *index_path = getenv("QNES_ROM_INDEX");
+  RomIndex index;
+  if (index_path && index.Open(index_path))
+  {
+    const std::shared_ptr<const RomImage> &image = console->GetCartridge()->GetImage();
+    const u32 crc32 = RomIndex::ContentCRC32(image->GetPRGROM(), image->GetLayout());
+
+    const RomIndexEntry *entry = index.Find(crc32);
+    if (entry && entry->PPUBackend != ROM_INDEX_NO_OVERRIDE && !backend_chosen)
+      backend = (PPUBackend)entry->PPUBackend;
+  }
+  console->GetPPU()->SetBackend(backend);
+
   Frontend *frontend = new SDL2GLFrontend(console);
   frontend->MainLoop();
   return 0;
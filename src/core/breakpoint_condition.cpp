@@ -0,0 +1,394 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "core/breakpoint_condition.h"
+
+// Expression grammar, loosest binding first (same precedence as C):
+//
+//   expr    := or
+//   or      := and ( "||" and )*
+//   and     := bitor ( "&&" bitor )*
+//   bitor   := bitxor ( "|" bitxor )*
+//   bitxor  := bitand ( "^" bitand )*
+//   bitand  := equal ( "&" equal )*
+//   equal   := compare ( ("==" | "!=") compare )*
+//   compare := sum ( ("<" | "<=" | ">" | ">=") sum )*
+//   sum     := unary ( ("+" | "-") unary )*
+//   unary   := ("!" | "~" | "-") unary | primary
+//   primary := number | variable | "[" expr "]" | "(" expr ")"
+//
+// Numbers are decimal, $hex, 0xhex or %binary. Variables are A, X, Y, P, SP, PC, scanline,
+// dot, addr and value (case-insensitive). [expr] reads a byte of CPU memory.
+//
+// Each sub-expression is compiled into the register named by its nesting depth, so the
+// result of the whole expression always ends up in r0.
+
+namespace
+{
+
+using Op = BreakpointCondition::Op;
+using Instruction = BreakpointCondition::Instruction;
+
+struct VariableName
+{
+  const char *name;
+  BreakpointContext::Variable variable;
+};
+
+const VariableName VARIABLE_NAMES[] = {
+    {"a", BreakpointContext::A},
+    {"x", BreakpointContext::X},
+    {"y", BreakpointContext::Y},
+    {"p", BreakpointContext::P},
+    {"sp", BreakpointContext::SP},
+    {"pc", BreakpointContext::PC},
+    {"scanline", BreakpointContext::Scanline},
+    {"dot", BreakpointContext::Dot},
+    {"addr", BreakpointContext::Addr},
+    {"value", BreakpointContext::Value},
+};
+
+class Compiler
+{
+public:
+  Compiler(const char *src, std::vector<Instruction> &code, std::vector<i32> &constants, std::string &error)
+      : cur(src), depth(0), code(code), constants(constants), error(error)
+  {
+  }
+
+  bool Run()
+  {
+    skip_space();
+    if (*cur == 0)
+      return true;
+
+    if (!parse_or(0))
+      return false;
+
+    skip_space();
+    if (*cur != 0)
+      return fail("unexpected characters");
+
+    return true;
+  }
+
+private:
+  // Unary operators, brackets and parentheses deep, so far
+  static const int MAX_DEPTH = 64;
+
+  const char *cur;
+  int depth;
+  std::vector<Instruction> &code;
+  std::vector<i32> &constants;
+  std::string &error;
+
+  bool fail(const char *message)
+  {
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s near '%.16s'", message, cur);
+    error = buffer;
+    return false;
+  }
+
+  void skip_space()
+  {
+    while (isspace((unsigned char)*cur))
+      cur++;
+  }
+
+  // Consume 'token' if it is next, but not if it is a prefix of a longer operator
+  // (so '&' does not eat the first half of '&&', and '<' does not eat '<=').
+  bool accept(const char *token)
+  {
+    skip_space();
+    const size_t len = strlen(token);
+    if (strncmp(cur, token, len) != 0)
+      return false;
+
+    if (len == 1)
+    {
+      if ((token[0] == '&' || token[0] == '|') && cur[1] == token[0])
+        return false;
+      if ((token[0] == '<' || token[0] == '>' || token[0] == '!') && cur[1] == '=')
+        return false;
+    }
+
+    cur += len;
+    return true;
+  }
+
+  void emit(Op op, int dst, int a = 0, int b = 0)
+  {
+    code.push_back({op, (u8)dst, (u8)a, (u8)b});
+  }
+
+  bool check_register(int reg)
+  {
+    if (reg >= BreakpointCondition::MAX_REGISTERS)
+      return fail("expression nested too deeply");
+    return true;
+  }
+
+  // Short-circuiting '&&' and '||'. Results are normalized to 0/1.
+  template <typename Next>
+  bool parse_logical(int dst, const char *token, Op jump, Next next)
+  {
+    if (!next(dst))
+      return false;
+
+    std::vector<size_t> patches;
+    while (accept(token))
+    {
+      emit(Op::Bool, dst, dst);
+      patches.push_back(code.size());
+      emit(jump, dst);
+
+      if (!next(dst))
+        return false;
+    }
+
+    if (patches.empty())
+      return true;
+
+    emit(Op::Bool, dst, dst);
+    const size_t target = code.size();
+    for (size_t patch : patches)
+    {
+      code[patch].a = target & 0xFF;
+      code[patch].b = (target >> 8) & 0xFF;
+    }
+    return true;
+  }
+
+  struct BinaryOperator
+  {
+    const char *token;
+    Op op;
+  };
+
+  template <size_t N, typename Next>
+  bool parse_binary(int dst, const BinaryOperator (&ops)[N], Next next)
+  {
+    if (!next(dst))
+      return false;
+
+    for (;;)
+    {
+      const BinaryOperator *matched = nullptr;
+      for (const BinaryOperator &op : ops)
+        if (accept(op.token))
+        {
+          matched = &op;
+          break;
+        }
+
+      if (!matched)
+        return true;
+
+      if (!check_register(dst + 1) || !next(dst + 1))
+        return false;
+
+      emit(matched->op, dst, dst, dst + 1);
+    }
+  }
+
+  bool parse_or(int dst)
+  {
+    return parse_logical(dst, "||", Op::JumpIfNonZero, [&](int r) { return parse_and(r); });
+  }
+
+  bool parse_and(int dst)
+  {
+    return parse_logical(dst, "&&", Op::JumpIfZero, [&](int r) { return parse_bitor(r); });
+  }
+
+  bool parse_bitor(int dst)
+  {
+    static const BinaryOperator ops[] = {{"|", Op::BitOr}};
+    return parse_binary(dst, ops, [&](int r) { return parse_bitxor(r); });
+  }
+
+  bool parse_bitxor(int dst)
+  {
+    static const BinaryOperator ops[] = {{"^", Op::BitXor}};
+    return parse_binary(dst, ops, [&](int r) { return parse_bitand(r); });
+  }
+
+  bool parse_bitand(int dst)
+  {
+    static const BinaryOperator ops[] = {{"&", Op::BitAnd}};
+    return parse_binary(dst, ops, [&](int r) { return parse_equal(r); });
+  }
+
+  bool parse_equal(int dst)
+  {
+    static const BinaryOperator ops[] = {{"==", Op::Eq}, {"!=", Op::Ne}};
+    return parse_binary(dst, ops, [&](int r) { return parse_compare(r); });
+  }
+
+  bool parse_compare(int dst)
+  {
+    static const BinaryOperator ops[] = {{"<=", Op::Le}, {">=", Op::Ge}, {"<", Op::Lt}, {">", Op::Gt}};
+    return parse_binary(dst, ops, [&](int r) { return parse_sum(r); });
+  }
+
+  bool parse_sum(int dst)
+  {
+    static const BinaryOperator ops[] = {{"+", Op::Add}, {"-", Op::Sub}};
+    return parse_binary(dst, ops, [&](int r) { return parse_unary(r); });
+  }
+
+  // Prefixes and brackets recurse through here without using up registers, so they are
+  // counted here instead.
+  bool parse_unary(int dst)
+  {
+    if (depth > MAX_DEPTH)
+      return fail("expression nested too deeply");
+
+    depth++;
+    const bool parsed = parse_prefixed(dst);
+    depth--;
+    return parsed;
+  }
+
+  bool parse_prefixed(int dst)
+  {
+    if (accept("!"))
+    {
+      if (!parse_unary(dst))
+        return false;
+      emit(Op::Not, dst, dst);
+      return true;
+    }
+    if (accept("~"))
+    {
+      if (!parse_unary(dst))
+        return false;
+      emit(Op::BitNot, dst, dst);
+      return true;
+    }
+    if (accept("-"))
+    {
+      if (!parse_unary(dst))
+        return false;
+      emit(Op::Neg, dst, dst);
+      return true;
+    }
+    return parse_primary(dst);
+  }
+
+  bool parse_primary(int dst)
+  {
+    skip_space();
+
+    if (accept("("))
+    {
+      if (!parse_or(dst))
+        return false;
+      if (!accept(")"))
+        return fail("expected ')'");
+      return true;
+    }
+
+    if (accept("["))
+    {
+      if (!parse_or(dst))
+        return false;
+      if (!accept("]"))
+        return fail("expected ']'");
+      emit(Op::LoadMem, dst, dst);
+      return true;
+    }
+
+    if (*cur == '$' || *cur == '%' || isdigit((unsigned char)*cur))
+      return parse_number(dst);
+
+    if (isalpha((unsigned char)*cur) || *cur == '_')
+    {
+      const char *start = cur;
+      while (isalnum((unsigned char)*cur) || *cur == '_')
+        cur++;
+
+      const size_t len = cur - start;
+      const auto matches = [&](const char *name) {
+        for (size_t i = 0; i < len; ++i)
+          if (name[i] == 0 || name[i] != tolower((unsigned char)start[i]))
+            return false;
+        return name[len] == 0;
+      };
+
+      for (const VariableName &var : VARIABLE_NAMES)
+        if (matches(var.name))
+        {
+          emit(Op::LoadVar, dst, var.variable);
+          return true;
+        }
+
+      cur = start;
+      return fail("unknown variable");
+    }
+
+    return fail("expected a value");
+  }
+
+  bool parse_number(int dst)
+  {
+    int base = 10;
+    if (*cur == '$')
+    {
+      base = 16;
+      cur++;
+    }
+    else if (*cur == '%')
+    {
+      base = 2;
+      cur++;
+    }
+    else if (cur[0] == '0' && (cur[1] == 'x' || cur[1] == 'X'))
+    {
+      base = 16;
+      cur += 2;
+    }
+
+    // strtoul() would also take leading space and a sign.
+    if (!isalnum((unsigned char)*cur))
+      return fail("malformed number");
+
+    char *end;
+    const unsigned long value = strtoul(cur, &end, base);
+    if (end == cur)
+      return fail("malformed number");
+    cur = end;
+
+    if (constants.size() >= 256)
+      return fail("too many constants");
+
+    emit(Op::LoadConst, dst, (int)constants.size());
+    constants.push_back((i32)value);
+    return true;
+  }
+};
+
+} // namespace
+
+bool BreakpointCondition::Compile(const char *expression, std::string &error)
+{
+  std::vector<Instruction> new_code;
+  std::vector<i32> new_constants;
+
+  Compiler compiler(expression, new_code, new_constants, error);
+  if (!compiler.Run())
+    return false;
+
+  if (new_code.size() > 0xFFFF)
+  {
+    error = "expression too long";
+    return false;
+  }
+
+  text = expression;
+  code.swap(new_code);
+  constants.swap(new_constants);
+  return true;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "core/types.h"
+
+// Everything a breakpoint condition is allowed to look at. This is filled in by the CPU only
+// when the breakpoint address bitmap already reported a hit, so it is never built on the
+// common path.
+struct BreakpointContext
+{
+  enum Variable
+  {
+    A,
+    X,
+    Y,
+    P,
+    SP,
+    PC,
+    Scanline,
+    Dot,
+    Addr,  // Address being accessed (execute, read or write)
+    Value, // Value being read or written. Zero for execute breakpoints.
+    NumVariables
+  };
+
+  u32 vars[NumVariables];
+
+  // Side-effect free memory access for [addr] terms.
+  u8 (*peek)(void *user, u16 addr);
+  void *peek_user;
+};
+
+// A condition such as "A == $40 && [$0300] > 3 && scanline < 20", parsed once and compiled
+// to a small register-based bytecode. Evaluation is a single pass over a handful of
+// 4-byte instructions with no allocation.
+class BreakpointCondition
+{
+public:
+  enum class Op : u8
+  {
+    LoadConst,   // r[dst] = constants[a]
+    LoadVar,     // r[dst] = ctx.vars[a]
+    LoadMem,     // r[dst] = peek(r[a] & 0xFFFF)
+    Not,         // r[dst] = !r[a]
+    BitNot,      // r[dst] = ~r[a]
+    Neg,         // r[dst] = -r[a]
+    Add,         // r[dst] = r[a] + r[b]
+    Sub,
+    BitAnd,
+    BitOr,
+    BitXor,
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Bool,        // r[dst] = r[a] != 0
+    JumpIfZero,  // if (r[dst] == 0) ip = a | (b << 8)
+    JumpIfNonZero,
+  };
+
+  struct Instruction
+  {
+    Op op;
+    u8 dst;
+    u8 a;
+    u8 b;
+  };
+
+  static const int MAX_REGISTERS = 16;
+
+  // Parse and compile an expression. An empty/blank expression compiles to "always true".
+  // On failure, returns false and describes the problem in 'error'.
+  bool Compile(const char *expression, std::string &error);
+
+  bool Evaluate(const BreakpointContext &ctx) const
+  {
+    if (code.empty())
+      return true;
+
+    i32 r[MAX_REGISTERS];
+    const Instruction *ip = code.data();
+    const Instruction *const end = ip + code.size();
+
+    while (ip != end)
+    {
+      const Instruction &in = *ip++;
+      switch (in.op)
+      {
+      case Op::LoadConst: r[in.dst] = constants[in.a]; break;
+      case Op::LoadVar: r[in.dst] = (i32)ctx.vars[in.a]; break;
+      case Op::LoadMem: r[in.dst] = ctx.peek(ctx.peek_user, (u16)r[in.a]); break;
+      case Op::Not: r[in.dst] = !r[in.a]; break;
+      case Op::BitNot: r[in.dst] = ~r[in.a]; break;
+      case Op::Neg: r[in.dst] = -r[in.a]; break;
+      case Op::Add: r[in.dst] = r[in.a] + r[in.b]; break;
+      case Op::Sub: r[in.dst] = r[in.a] - r[in.b]; break;
+      case Op::BitAnd: r[in.dst] = r[in.a] & r[in.b]; break;
+      case Op::BitOr: r[in.dst] = r[in.a] | r[in.b]; break;
+      case Op::BitXor: r[in.dst] = r[in.a] ^ r[in.b]; break;
+      case Op::Eq: r[in.dst] = r[in.a] == r[in.b]; break;
+      case Op::Ne: r[in.dst] = r[in.a] != r[in.b]; break;
+      case Op::Lt: r[in.dst] = r[in.a] < r[in.b]; break;
+      case Op::Le: r[in.dst] = r[in.a] <= r[in.b]; break;
+      case Op::Gt: r[in.dst] = r[in.a] > r[in.b]; break;
+      case Op::Ge: r[in.dst] = r[in.a] >= r[in.b]; break;
+      case Op::Bool: r[in.dst] = r[in.a] != 0; break;
+      case Op::JumpIfZero:
+        if (r[in.dst] == 0)
+          ip = code.data() + (in.a | (in.b << 8));
+        break;
+      case Op::JumpIfNonZero:
+        if (r[in.dst] != 0)
+          ip = code.data() + (in.a | (in.b << 8));
+        break;
+      }
+    }
+
+    return r[0] != 0;
+  }
+
+  const std::string &GetText() const { return text; }
+  const std::vector<Instruction> &GetCode() const { return code; }
+
+private:
+  std::string text;
+  std::vector<Instruction> code;
+  std::vector<i32> constants;
+};
@@ -1,13 +1,20 @@
 #include <cassert>
 #include "core/bus.h"
+#include "core/log.h"
 #include <cstring>
 
+static const u8 *const NO_READ_SLOTS[8] = {};
+static u8 *const NO_WRITE_SLOTS[8] = {};
+
 Bus::Bus()
+    : cartridge_read_slots(NO_READ_SLOTS),
+      cartridge_write_slots(NO_WRITE_SLOTS),
+      cartridge_save_ram(nullptr)
 {
   RAM = new u8[0x0800];
   memset(RAM, 0, 0x0800);
   RAMWriteLastPC = new u16[0x0800];
-  memset(RAMWriteLastPC, 0, 0x0800);
+  memset(RAMWriteLastPC, 0, 0x0800 * sizeof(u16));
 }
 
 Bus::~Bus()
@@ -16,12 +23,20 @@ Bus::~Bus()
   delete[] RAMWriteLastPC;
 }
 
+void Bus::SetCartridge(std::shared_ptr<Cartridge> cartridge)
+{
+  this->cartridge = cartridge;
+  cartridge_read_slots = cartridge ? cartridge->GetPRGReadSlots() : NO_READ_SLOTS;
+  cartridge_write_slots = cartridge ? cartridge->GetPRGWriteSlots() : NO_WRITE_SLOTS;
+  cartridge_save_ram = cartridge ? cartridge->GetSaveRAM() : nullptr;
+}
+
 u8 Bus::Read(u16 address, bool affects_state)
 {
-  u8 val;
-  if (cartridge->CPURead(address, val))
+  // Cartridge space is mapped straight to memory; nothing below $6000 ever is.
+  if (const u8 *slot = cartridge_read_slots[address >> 13])
   {
-    return val;
+    return slot[address & 0x1FFF];
   }
   else if (address < 0x2000)
   {
@@ -32,7 +47,7 @@ u8 Bus::Read(u16 address, bool affects_state)
   {
     // PPU Registers 8 bytes mirrored
     address = 0x2000 | (address & 7);
-    return ppu->Read(address);
+    return affects_state ? ppu->Read(address) : ppu->Peek(address);
   }
   else if (address >= 0x4000 && address < 0x4013)
   {
@@ -41,7 +56,7 @@ u8 Bus::Read(u16 address, bool affects_state)
   }
   else if (address == 0x4016 || address == 0x4017)
   {
-    return controllers->ShiftJoyPadBit(address & 1);
+    return affects_state ? controllers->ShiftJoyPadBit(address & 1) : controllers->PeekJoyPadBit(address & 1);
   }
   else if (address < 0x4020)
   {
@@ -51,13 +66,20 @@ u8 Bus::Read(u16 address, bool affects_state)
   }
   else
   {
-    assert(0);
+    // Cartridge space with nothing mapped: open bus
+    return 0;
   }
 }
 
 void Bus::Write(u16 address, u8 val)
 {
-  if (cartridge->CPUWrite(address, val))
+  if (u8 *slot = cartridge_write_slots[address >> 13])
+  {
+    slot[address & 0x1FFF] = val;
+    if (cartridge_save_ram)
+      cartridge_save_ram->NoteWrite(slot + (address & 0x1FFF));
+  }
+  else if (address >= 0x4020 && write_cartridge(address, val))
   {
     return;
   }
@@ -88,7 +110,7 @@ void Bus::Write(u16 address, u8 val)
   }
   else
   {
-    printf("Unimplemented bus write @ 0x%04X\n", address);
+    LOG_WARNING(Bus, "Unimplemented bus write @ 0x%04X", address);
    // assert(0 && "Write not implemented outside ram");
   }
 }
@@ -97,3 +119,21 @@ void Bus::TriggerNMI()
 {
   cpu->TriggerNMI();
 }
+
+void Bus::SetCartridgeIRQ(bool asserted)
+{
+  cpu->SetIRQ(CPU::IRQ_CARTRIDGE, asserted);
+}
+
+bool Bus::write_cartridge(u16 address, u8 val)
+{
+  if (!cartridge->HasScanlineCounter())
+    return cartridge->CPUWrite(address, val);
+
+  // The counter has to be up to date before its registers change, and its IRQ
+  // rescheduled after.
+  ppu->SyncScanlineCounter();
+  const bool handled = cartridge->CPUWrite(address, val);
+  ppu->ScheduleScanlineIRQ();
+  return handled;
+}
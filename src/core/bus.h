@@ -15,23 +15,37 @@ private:
   std::shared_ptr<Cartridge> cartridge;
   std::shared_ptr<Controllers> controllers;
 
+  // The cartridge's PRG slot tables (see Cartridge::GetPRGReadSlots()), so reads and RAM
+  // writes to it skip the mapper entirely. Empty until there is a cartridge.
+  const u8 *const *cartridge_read_slots;
+  u8 *const *cartridge_write_slots;
+
+  // Where RAM writes are noted, when the cartridge's PRG-RAM is a save file
+  SaveRAM *cartridge_save_ram;
+
   u8 *RAM;
   u16 *RAMWriteLastPC;
 
+  bool write_cartridge(u16 address, u8 val);
+
 public:
   Bus();
   ~Bus();
 
   void SetCPU(std::shared_ptr<CPU> cpu) { this->cpu = cpu; }
   void SetPPU(std::shared_ptr<PPU> ppu) { this->ppu = ppu; }
-  void SetCartridge(std::shared_ptr<Cartridge> cartridge) { this->cartridge = cartridge; }
+  void SetCartridge(std::shared_ptr<Cartridge> cartridge);
   std::shared_ptr<Cartridge> GetCartridge() { return cartridge; }
 
   void SetControllers(std::shared_ptr<Controllers> controllers) { this->controllers = controllers; }
 
   std::shared_ptr<CPU> &GetCPU() { return cpu; }
+  std::shared_ptr<PPU> &GetPPU() { return ppu; }
 
   void TriggerNMI();
+  void SetCartridgeIRQ(bool asserted);
+  // Reads with affects_state == false have no side effects (PPU latches, controller shift
+  // registers), which is what debugger views and breakpoint conditions need.
   u8 Read(u16 address, bool affects_state = true);
   void Write(u16 address, u8 val);
 
@@ -1,17 +1,51 @@
-#include <cstdio>
+#include <algorithm>
 #include <cstring>
-#include <cstdlib>
+#include <filesystem>
 #include "core/cartridge.h"
+#include "core/log.h"
+#include "core/rom_image.h"
 
 #include "mappers/mapper_000.h"
 #include "mappers/mapper_001.h"
-#include "mappers/mapper_002.h"
-#include "mappers/mapper_003.h"
+#include "mappers/mapper_004.h"
+#include "mappers/discrete_mapper.h"
 
-Cartridge *Cartridge::LoadRomFile(const char *path)
+const char *GetRomLoadErrorString(RomLoadError error)
 {
-  FILE *romFile = fopen(path, "r");
+  switch (error)
+  {
+  case RomLoadError::None:
+    return "no error";
+  case RomLoadError::CannotOpen:
+    return "the file could not be opened";
+  case RomLoadError::NotINES:
+    return "missing the required iNES header";
+  case RomLoadError::Truncated:
+    return "shorter than its header says";
+  case RomLoadError::HasTrainer:
+    return "has a built-in trainer, which is not handled";
+  case RomLoadError::UnsupportedMapper:
+    return "unsupported mapper";
+  }
+  return "unknown error";
+}
+
+// A PRG or CHR size from the header: a count of 'unit' bytes, or in NES 2.0, when the top
+// nibble is all ones, 2^E * (M*2+1) bytes.
+static u32 get_rom_size(u32 units, u32 unit)
+{
+  if ((units & 0xF00) != 0xF00)
+    return units * unit;
+
+  const u32 exponent = (units >> 2) & 0x3F;
+  const u32 multiplier = (units & 3) * 2 + 1;
+  if (exponent > 26) // Way more than any cartridge, and more than a u32 holds
+    return 0xFFFFFFFF;
+  return (1u << exponent) * multiplier;
+}
 
+RomLoadError Cartridge::ParseHeader(const u8 *data, size_t size, CartridgeDescription &description, RomLayout &layout)
+{
   // iNES File Format
   // 1. 16-byte Header
   // 2. Trainer, if present (0 or 512 bytes)
@@ -19,78 +53,286 @@ Cartridge *Cartridge::LoadRomFile(const char *path)
   // 4. CHR ROM data, if present (8192 * y bytes)
   // ... (PlayChoice stuff, but don't care about that)
 
-  u8 header[16];
-  fread(header, sizeof(u8), 16, romFile);
-
   // Confirm this is an iNES File first
-  static u8 iNESMagicHeader[4] = {0x4E, 0x45, 0x53, 0x1A};
-  if (memcmp(header, iNESMagicHeader, 4) != 0)
+  static const u8 iNESMagicHeader[4] = {0x4E, 0x45, 0x53, 0x1A};
+  if (size < 16 || memcmp(data, iNESMagicHeader, 4) != 0)
+    return RomLoadError::NotINES;
+
+  const u8 *header = data;
+  description.HardwiredMirroringModeIsVertical = header[6] & 1;
+  description.HasBatteryBackedRAM = header[6] & 2;
+  description.HasTrainer = header[6] & 4;
+  description.IgnoreMirroringControl = header[6] & 8;
+  description.IsNES2 = (header[7] & 0x0C) == 0x08;
+  description.SubmapperNumber = 0;
+  description.CHRRAMSize = 0;
+  description.PRGRAMSize = 0x2000;
+
+  u32 prg_units = header[4];
+  u32 chr_units = header[5];
+  if (description.IsNES2)
   {
-    printf("File '%s' is missing the required iNES Header.\n", path);
-    exit(1);
-  }
+    // Byte 8 has the mapper's top bits and the submapper, byte 9 the sizes' top bits.
+    description.MapperNumber = (header[6] >> 4) | (header[7] & 0xF0) | ((header[8] & 0x0F) << 8);
+    description.SubmapperNumber = header[8] >> 4;
+    prg_units |= (header[9] & 0x0F) << 8;
+    chr_units |= (header[9] & 0xF0) << 4;
 
-  bool romHasTrainer = header[6] & 4;
-  if (romHasTrainer)
+    // Byte 11 has CHR-RAM sizes as shift counts, volatile and battery-backed; either way
+    // it is just RAM here.
+    for (int shift : {header[11] & 0x0F, header[11] >> 4})
+      if (shift)
+        description.CHRRAMSize = std::max(description.CHRRAMSize, 64u << shift);
+
+    // Byte 10 likewise for PRG-RAM; here 0 means there is none.
+    description.PRGRAMSize = 0;
+    for (int shift : {header[10] & 0x0F, header[10] >> 4})
+      if (shift)
+        description.PRGRAMSize = std::max(description.PRGRAMSize, 64u << shift);
+  }
+  else
   {
-    printf("Rom has a built-in trainer, which is not handled.\n");
-    exit(1);
+    // Old dumping tools wrote a signature ("DiskDude!") over bytes 7-15, which leaves
+    // garbage in the mapper number's top half.
+    const bool has_garbage = header[12] | header[13] | header[14] | header[15];
+    description.MapperNumber = (header[6] >> 4) | (has_garbage ? 0 : header[7] & 0xF0);
   }
 
-  CartridgeDescription description;
-  description.PRG_ROM_16KB_Multiple = header[4];
-  description.CHR_ROM_8KB_Multiple = header[5];
-  description.HardwiredMirroringModeIsVertical = header[6] & 1;
-  description.HasBatteryBackedRAM = header[6] & 2;
-  description.IgnoreMirroringControl = header[6] & 8;
-  description.MapperNumber = (header[6] >> 4) | (header[7] & 0xF0);
+  layout.PRGOffset = description.HasTrainer ? 16 + 512 : 16;
+  layout.PRGSize = get_rom_size(prg_units, 0x4000);
+  layout.CHROffset = layout.PRGOffset + layout.PRGSize;
+  layout.CHRSize = get_rom_size(chr_units, 0x2000);
+  description.PRG_ROM_16KB_Multiple = layout.PRGSize / 0x4000;
+  description.CHR_ROM_8KB_Multiple = layout.CHRSize / 0x2000;
 
-  // Print the description
-  printf("Loaded rom file '%s' (Mapper %d, %uKB PRG-ROM, %uKB CHR-ROM",
-         path,
-         description.MapperNumber,
-         16 * description.PRG_ROM_16KB_Multiple,
-         8 * description.CHR_ROM_8KB_Multiple);
+  if (!layout.CHRSize && !description.CHRRAMSize)
+    description.CHRRAMSize = 0x2000;
+  if (description.CHRRAMSize > Cartridge::MAX_CHR_RAM_SIZE)
+    description.CHRRAMSize = Cartridge::MAX_CHR_RAM_SIZE;
+  if (description.PRGRAMSize > Cartridge::MAX_PRG_RAM_SIZE)
+    description.PRGRAMSize = Cartridge::MAX_PRG_RAM_SIZE;
 
-  if (description.HasBatteryBackedRAM)
-    printf(", Battery-Backed RAM");
+  if (size < (u64)layout.PRGOffset + layout.PRGSize + layout.CHRSize)
+    return RomLoadError::Truncated;
 
-  printf(")\n");
+  return RomLoadError::None;
+}
+
+RomLoadError Cartridge::LoadRomFile(const char *path, Cartridge *&cartridge)
+{
+  std::shared_ptr<const RomImage> image;
+  RomLoadError error = RomImage::Load(path, image);
+  return load_rom(error, image, cartridge);
+}
+
+RomLoadError Cartridge::LoadRomFromMemory(const u8 *data, size_t size, Cartridge *&cartridge)
+{
+  std::shared_ptr<const RomImage> image;
+  RomLoadError error = RomImage::FromMemory(data, size, image);
+  return load_rom(error, image, cartridge);
+}
+
+RomLoadError Cartridge::LoadRomImage(std::shared_ptr<const RomImage> image, Cartridge *&cartridge)
+{
+  return load_rom(RomLoadError::None, image, cartridge);
+}
+
+// Keep in step with the mappers load_rom() creates.
+bool Cartridge::IsMapperSupported(int mapper_number)
+{
+  switch (mapper_number)
+  {
+  case 0:
+  case 1:
+  case 4:
+    return true;
+
+  default:
+    return FindDiscreteMapperLayout(mapper_number) != nullptr;
+  }
+}
+
+RomLoadError Cartridge::load_rom(RomLoadError error, std::shared_ptr<const RomImage> image, Cartridge *&cartridge)
+{
+  cartridge = nullptr;
+  if (error != RomLoadError::None)
+    return error;
+
+  const CartridgeDescription &description = image->GetDescription();
+  if (description.HasTrainer)
+    return RomLoadError::HasTrainer;
+
+  const u8 *prg_rom = image->GetPRGROM();
+  const u8 *chr_rom = image->GetCHRROM();
 
   Cartridge *result;
   switch (description.MapperNumber)
   {
   case 0:
-    result = new Mapper_000(description);
+    result = new Mapper_000(description, prg_rom, chr_rom);
     break;
 
   case 1:
-    result = new Mapper_001(description);
-    break;
-
-  case 2:
-    result = new Mapper_002(description);
+    result = new Mapper_001(description, prg_rom, chr_rom);
     break;
 
-    case 3:
-    result = new Mapper_003(description);
+  case 4:
+    result = new Mapper_004(description, prg_rom, chr_rom);
     break;
 
   default:
-    printf("Unsupported Mapper %u.\n", description.MapperNumber);
-    exit(1);
-    break;
+    if (const DiscreteMapperLayout *layout = FindDiscreteMapperLayout(description.MapperNumber))
+      result = new DiscreteMapper(*layout, description, prg_rom, chr_rom);
+    else
+      return RomLoadError::UnsupportedMapper;
   }
+  result->image = image;
 
-  int prg_rom_bytes = 0x4000 * description.PRG_ROM_16KB_Multiple;
-  result->PRG_ROM = new u8[prg_rom_bytes];
-  fread(result->PRG_ROM, sizeof(u8), prg_rom_bytes, romFile);
+  // Only boards whose mapper has mapped PRG-RAM by now get a save file.
+  if (description.HasBatteryBackedRAM && !image->GetPath().empty() && result->prg_ram)
+    result->open_save_file(image->GetPath().c_str());
 
-  int chr_rom_bytes = 0x2000 * description.CHR_ROM_8KB_Multiple;
-  result->CHR_ROM = new u8[chr_rom_bytes];
-  fread(result->CHR_ROM, sizeof(u8), chr_rom_bytes, romFile);
+  // Debug, not info: starting thousands of consoles would otherwise fill the log with it.
+  LOG_DEBUG(Cartridge, "Loaded rom (Mapper %d, %uKB PRG-ROM, %uKB CHR-ROM%s)",
+            description.MapperNumber,
+            16 * description.PRG_ROM_16KB_Multiple,
+            8 * description.CHR_ROM_8KB_Multiple,
+            description.HasBatteryBackedRAM ? ", Battery-Backed RAM" : "");
 
-  fclose(romFile);
+  cartridge = result;
+  return RomLoadError::None;
+}
+
+Cartridge::Cartridge(CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom)
+    : description(description), PRG_ROM(prg_rom), CHR_ROM(chr_rom), prg_read_slots{},
+      prg_write_slots{}, chr_read_slots{}, chr_write_slots{}, prg_ram(nullptr),
+      prg_ram_size(0), chr_bank_serial(0),
+      chr_ram_size(0), chr_dirty_tiles{}, chr_dirty_pages(0), has_scanline_counter(false),
+      irq_asserted(false), nametable_ram(nullptr), nametable_pages{}
+{
+  if (!chr_rom && description.CHRRAMSize)
+  {
+    chr_ram_size = description.CHRRAMSize;
+    chr_ram.reset(new u8[chr_ram_size]);
+    memset(chr_ram.get(), 0, chr_ram_size);
+  }
+
+  // Until the mapper says otherwise, mirroring is what the header says.
+  if (description.IgnoreMirroringControl)
+    mirroring = MirroringMode::FourScreen;
+  else
+    mirroring = description.HardwiredMirroringModeIsVertical ? MirroringMode::Vertical : MirroringMode::Horizontal;
+}
+
+const TileCache *Cartridge::GetCHRROMTiles() const
+{
+  return image && CHR_ROM ? &image->GetCHRROMTiles() : nullptr;
+}
+
+bool Cartridge::MapCHR(u16 addr, u32 &offset) const
+{
+  const u8 *slot = chr_read_slots[(addr >> 10) & 7];
+  if (!slot)
+    return false;
+
+  offset = (slot - GetCHRMemory()) + (addr & 0x3FF);
+  return true;
+}
+
+void Cartridge::MapPRGROM(u16 addr, u32 size, u32 offset)
+{
+  const u32 prg_size = GetPRGROMSize();
+  for (u32 done = 0; done < size; done += 0x2000)
+  {
+    const int slot = (addr + done) >> 13;
+    prg_read_slots[slot] = prg_size ? PRG_ROM + (offset + done) % prg_size : nullptr;
+    prg_write_slots[slot] = nullptr;
+  }
+}
+
+void Cartridge::MapPRGRAM(u16 addr, u32 size, u32 offset)
+{
+  // Made on first use, so boards that never map any have none.
+  if (!prg_ram && description.PRGRAMSize)
+  {
+    prg_ram_size = description.PRGRAMSize;
+    volatile_prg_ram.reset(new u8[prg_ram_size]);
+    memset(volatile_prg_ram.get(), 0, prg_ram_size);
+    prg_ram = volatile_prg_ram.get();
+  }
+
+  for (u32 done = 0; done < size; done += 0x2000)
+  {
+    const int slot = (addr + done) >> 13;
+    u8 *ram = prg_ram_size ? prg_ram + (offset + done) % prg_ram_size : nullptr;
+    prg_read_slots[slot] = ram;
+    prg_write_slots[slot] = ram;
+  }
+}
+
+void Cartridge::open_save_file(const char *rom_path)
+{
+  const std::string path = std::filesystem::path(rom_path).replace_extension(".sav").string();
+  SaveRAM *save = SaveRAM::Open(path.c_str(), prg_ram_size);
+  if (!save)
+  {
+    LOG_WARNING(Cartridge, "Could not open the save file, or another console has it; battery-backed RAM will not be kept");
+    return;
+  }
+
+  // The mapper has already mapped the RAM; the same offsets in the file take its place.
+  for (int slot = 0; slot < 8; ++slot)
+  {
+    u8 *ram = prg_write_slots[slot];
+    if (ram >= prg_ram && ram < prg_ram + prg_ram_size)
+    {
+      prg_read_slots[slot] = save->GetData() + (ram - prg_ram);
+      prg_write_slots[slot] = save->GetData() + (ram - prg_ram);
+    }
+  }
+
+  save_ram.reset(save);
+  volatile_prg_ram.reset();
+  prg_ram = save->GetData();
+}
+
+void Cartridge::MapCHRMemory(u16 addr, u32 size, u32 offset)
+{
+  const u32 chr_size = GetCHRMemorySize();
+  for (u32 done = 0; done < size; done += 0x400)
+  {
+    const int slot = (addr + done) >> 10;
+    const u32 slot_offset = chr_size ? (offset + done) % chr_size : 0;
+    chr_read_slots[slot] = chr_size ? GetCHRMemory() + slot_offset : nullptr;
+    chr_write_slots[slot] = chr_ram ? chr_ram.get() + slot_offset : nullptr;
+  }
+  chr_bank_serial++;
+}
+
+const u8 *GetMirroringPages(MirroringMode mode)
+{
+  static const u8 pages[5][4] = {
+      {0, 0, 1, 1}, // Horizontal
+      {0, 1, 0, 1}, // Vertical
+      {0, 0, 0, 0}, // OneScreenLow
+      {1, 1, 1, 1}, // OneScreenHigh
+      {0, 1, 2, 3}, // FourScreen
+  };
+  return pages[(int)mode];
+}
+
+void Cartridge::SetMirroring(MirroringMode mode)
+{
+  mirroring = mode;
+  if (nametable_ram)
+    AttachNametableRAM(nametable_ram);
+}
+
+void Cartridge::AttachNametableRAM(u8 *ram)
+{
+  nametable_ram = ram;
 
-  return result;
-}
\ No newline at end of file
+  const u8 *pages = GetMirroringPages(mirroring);
+  for (int i = 0; i < 4; ++i)
+    nametable_pages[i] = ram + 0x400 * pages[i];
+}
@@ -1,39 +1,278 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include "core/save_ram.h"
 #include "core/types.h"
 
+class RomImage;
+class TileCache;
+
 struct CartridgeDescription
 {
-  u8 PRG_ROM_16KB_Multiple;
-  u8 CHR_ROM_8KB_Multiple;
+  u16 PRG_ROM_16KB_Multiple;
+  u16 CHR_ROM_8KB_Multiple;
 
   bool HardwiredMirroringModeIsVertical;
   bool HasBatteryBackedRAM;
   bool IgnoreMirroringControl;
-  u8 MapperNumber;
+  bool HasTrainer;
+  u16 MapperNumber;
+
+  // NES 2.0 headers only; 0 otherwise.
+  bool IsNES2;
+  u8 SubmapperNumber;
+
+  // Bytes of CHR-RAM: as NES 2.0 headers say, otherwise 8KB on boards without CHR-ROM.
+  u32 CHRRAMSize;
+
+  // Bytes of PRG-RAM, on boards that have any: as NES 2.0 headers say, otherwise 8KB.
+  u32 PRGRAMSize;
+};
+
+// Where the parts of an iNES image are, as its header describes them. The sizes are exact,
+// even for NES 2.0's exponent-multiplier sizes, which the multiples above round down.
+struct RomLayout
+{
+  u32 PRGOffset;
+  u32 PRGSize;
+  u32 CHROffset;
+  u32 CHRSize;
+};
+
+// Why a ROM could not be loaded.
+enum class RomLoadError
+{
+  None,
+  CannotOpen,        // Missing or unreadable file
+  NotINES,           // No iNES header
+  Truncated,         // Shorter than its header says
+  HasTrainer,        // Trainers are not handled
+  UnsupportedMapper,
+};
+
+const char *GetRomLoadErrorString(RomLoadError error);
+
+// How the four nametables ($2000, $2400, $2800, $2C00) map onto nametable RAM.
+enum class MirroringMode : u8
+{
+  Horizontal,    // $2000 = $2400, $2800 = $2C00
+  Vertical,      // $2000 = $2800, $2400 = $2C00
+  OneScreenLow,  // All four use the first 1KB page
+  OneScreenHigh, // All four use the second 1KB page
+  FourScreen,    // Four separate pages, using 2KB of extra RAM on the cartridge
 };
 
+// The 1KB page of nametable RAM that each of the four nametables uses under 'mode'.
+const u8 *GetMirroringPages(MirroringMode mode);
+
 class Cartridge
 {
 protected:
   CartridgeDescription description;
-  u8 *PRG_ROM;
-  u8 *CHR_ROM;
+  const u8 *PRG_ROM;
+  const u8 *CHR_ROM;
+
+  // What PRG_ROM and CHR_ROM point into, shared with every other cartridge of the same
+  // ROM; everything else here is this cartridge's own.
+  std::shared_ptr<const RomImage> image;
+
+  // Where each 8KB slot of CPU address space ($0000, $2000, ... $E000) reads from, and for
+  // RAM writes to, or nullptr. Mappers point them at PRG-ROM and PRG-RAM (see MapPRGROM()
+  // and MapPRGRAM()) only when their registers change, so a read is a shift, an index and
+  // a load. Slots below $6000 are never used.
+  const u8 *prg_read_slots[8];
+  u8 *prg_write_slots[8];
+
+  // Likewise for the pattern tables, in 1KB slots ($0000, $0400, ... $1C00), which are
+  // writable on boards with CHR-RAM.
+  const u8 *chr_read_slots[8];
+  u8 *chr_write_slots[8];
+
+  // PRG-RAM, once the mapper maps it (see MapPRGRAM()): the save file's mapping when it is
+  // battery-backed and the ROM came from a file, otherwise plain memory.
+  u8 *prg_ram;
+  u32 prg_ram_size;
+  std::unique_ptr<u8[]> volatile_prg_ram;
+  std::unique_ptr<SaveRAM> save_ram;
+
+  // Bumped whenever the CHR slots change.
+  u32 chr_bank_serial;
+
+  // CHR-RAM, on boards without CHR-ROM, and what has been written to it since it was last
+  // taken (see TakeCHRDirtyTiles()): a bit per 16-byte tile, a u64 of those per 1KB page,
+  // and a bit per page with any set.
+  std::unique_ptr<u8[]> chr_ram;
+  u32 chr_ram_size;
+  u64 chr_dirty_tiles[64];
+  u64 chr_dirty_pages;
+
+  // Set by mappers with a scanline counter (see ClockScanlineCounter()).
+  bool has_scanline_counter;
+
+  // Whether the cartridge is holding the CPU's IRQ line.
+  bool irq_asserted;
+
+  // Nametable RAM lives in the PPU (see AttachNametableRAM()); the cartridge decides which
+  // page of it each nametable uses.
+  MirroringMode mirroring;
+  u8 *nametable_ram;
+  u8 *nametable_pages[4];
+
+  // For mappers that switch mirroring.
+  void SetMirroring(MirroringMode mode);
+
+  // For mappers: show 'size' bytes of PRG-ROM from 'offset' on (wrapping around the end of
+  // PRG-ROM, as unconnected bank bits do) at CPU address 'addr'. 8KB granularity.
+  void MapPRGROM(u16 addr, u32 size, u32 offset);
+
+  // Likewise for PRG-RAM, which is readable and writable.
+  void MapPRGRAM(u16 addr, u32 size, u32 offset);
+
+  // Show 'size' bytes of CHR memory (CHR-ROM, or CHR-RAM on boards without it) from
+  // 'offset' on at pattern table address 'addr', wrapping around its end. 1KB granularity.
+  void MapCHRMemory(u16 addr, u32 size, u32 offset);
+
+private:
+  static RomLoadError load_rom(RomLoadError error, std::shared_ptr<const RomImage> image, Cartridge *&cartridge);
+  void open_save_file(const char *rom_path);
 
 public:
-  static Cartridge *LoadRomFile(const char *path);
+  // The most CHR-RAM a cartridge gets; no board has more.
+  static const u32 MAX_CHR_RAM_SIZE = 0x10000;
+  static const u32 MAX_PRG_RAM_SIZE = 0x10000;
+
+  // 'prg_rom' and 'chr_rom' (nullptr if there is none, in which case the cartridge has
+  // description.CHRRAMSize bytes of CHR-RAM) have to outlive the cartridge.
+  Cartridge(CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom);
+
+  // Works out what the iNES or NES 2.0 image 'data' holds, without loading it.
+  static RomLoadError ParseHeader(const u8 *data, size_t size, CartridgeDescription &description, RomLayout &layout);
+
+  // Load a ROM by mapping its file into memory; PRG-ROM and CHR-ROM are read straight from
+  // the mapping, so nothing is copied. Loading a file already loaded shares its RomImage,
+  // so costs next to nothing. Battery-backed PRG-RAM is kept beside it, with the extension
+  // replaced by .sav.
+  static RomLoadError LoadRomFile(const char *path, Cartridge *&cartridge);
+
+  // A new cartridge of a ROM loaded already.
+  static RomLoadError LoadRomImage(std::shared_ptr<const RomImage> image, Cartridge *&cartridge);
+
+  // Load a ROM already in memory, e.g. embedded in the program. Nothing is copied, so
+  // 'data' has to stay valid for as long as the cartridge is around. PRG-RAM is never
+  // saved.
+  static RomLoadError LoadRomFromMemory(const u8 *data, size_t size, Cartridge *&cartridge);
+
+  // Whether LoadRomFile() and LoadRomFromMemory() have a mapper for this mapper number.
+  static bool IsMapperSupported(int mapper_number);
+
   const CartridgeDescription &GetDescription() const { return description; }
 
-  virtual ~Cartridge()
+  virtual ~Cartridge() {}
+
+  // Reads go through the slots; false where nothing is mapped.
+  bool CPURead(u16 addr, u8 &val) const
   {
-    delete[] PRG_ROM;
-    delete[] CHR_ROM;
+    const u8 *slot = prg_read_slots[addr >> 13];
+    if (!slot)
+      return false;
+    val = slot[addr & 0x1FFF];
+    return true;
   }
 
-  virtual bool CPURead(u16 addr, u8 &val) = 0;
+  bool PPURead(u16 addr, u8 &val) const
+  {
+    const u8 *slot = addr < 0x2000 ? chr_read_slots[addr >> 10] : nullptr;
+    if (!slot)
+      return false;
+    val = slot[addr & 0x3FF];
+    return true;
+  }
+
+  // Writes to RAM slots land there; anything else is up to the mapper, e.g. its registers.
   virtual bool CPUWrite(u16 addr, u8 val) = 0;
 
-  virtual bool PPURead(u16 addr, u8 &val) = 0;
-  virtual bool PPUWrite(u16 addr, u8 val) = 0;
+  // Writes to CHR-RAM, which mark their tile dirty; false where it is not mapped.
+  bool PPUWrite(u16 addr, u8 val)
+  {
+    u8 *slot = addr < 0x2000 ? chr_write_slots[addr >> 10] : nullptr;
+    if (!slot)
+      return false;
+
+    u8 *byte = slot + (addr & 0x3FF);
+    *byte = val;
+    const u32 offset = byte - chr_ram.get();
+    chr_dirty_tiles[offset >> 10] |= 1ull << ((offset >> 4) & 63);
+    chr_dirty_pages |= 1ull << (offset >> 10);
+    return true;
+  }
+
+  // The slot tables themselves, for the bus and PPU to read through directly. They stay
+  // where they are for the cartridge's lifetime.
+  const u8 *const *GetPRGReadSlots() const { return prg_read_slots; }
+  u8 *const *GetPRGWriteSlots() const { return prg_write_slots; }
+  const u8 *const *GetCHRReadSlots() const { return chr_read_slots; }
+
+  // Where pattern table address 'addr' (< $2000) currently lands in CHR memory (see
+  // GetCHRMemory()). Returns false if it is not mapped. Used by the PPU's tile cache, which
+  // re-queries the mapping whenever GetCHRBankSerial() changes.
+  bool MapCHR(u16 addr, u32 &offset) const;
+
+  u32 GetCHRBankSerial() const { return chr_bank_serial; }
+
+  // The save file PRG-RAM is kept in, or nullptr. Writes through the PRG write slots have
+  // to be noted to it (see SaveRAM::NoteWrite()).
+  SaveRAM *GetSaveRAM() const { return save_ram.get(); }
+
+  // CHR-ROM, or CHR-RAM on boards without it.
+  const u8 *GetCHRMemory() const { return CHR_ROM ? CHR_ROM : chr_ram.get(); }
+  u32 GetCHRMemorySize() const { return CHR_ROM ? GetCHRROMSize() : chr_ram_size; }
+  bool HasCHRRAM() const { return chr_ram != nullptr; }
+
+  // CHR-ROM decoded once for every cartridge of this ROM (see TileCache::Share()), or
+  // nullptr, e.g. on boards with CHR-RAM.
+  const TileCache *GetCHRROMTiles() const;
+
+  const std::shared_ptr<const RomImage> &GetImage() const { return image; }
+
+  // The 1KB pages of CHR-RAM written since their tiles were last taken, as bits, so that
+  // caches of it (decoded tiles, debug views) only drop what changed.
+  u64 GetCHRDirtyPages() const { return chr_dirty_pages; }
+
+  // The tiles of 'page' written since the last call, as bits, which are cleared.
+  u64 TakeCHRDirtyTiles(int page)
+  {
+    const u64 tiles = chr_dirty_tiles[page];
+    chr_dirty_tiles[page] = 0;
+    chr_dirty_pages &= ~(1ull << page);
+    return tiles;
+  }
+
+  // Scanline counters (MMC3 and the like) count rising edges of the PPU's A12 address
+  // line, which happen at fixed dots of each rendered line. Rather than the mapper
+  // watching every fetch, the PPU works out when they happen from its fetch schedule and
+  // hands them over in batches (see PPU::SyncScanlineCounter()): before the counter's
+  // registers are written, when the PPU changes the schedule, and when the clock the
+  // counter raises its IRQ on comes around.
+  bool HasScanlineCounter() const { return has_scanline_counter; }
+  virtual void ClockScanlineCounter(u32 clocks) {}
+
+  // How many more clocks until the counter raises its IRQ, or 0 if it never will as its
+  // registers are now.
+  virtual u32 GetScanlineClocksUntilIRQ() const { return 0; }
+
+  bool IsIRQAsserted() const { return irq_asserted; }
+
+  // Point the nametables at 'ram' (4KB: the PPU's 2KB, plus room for four-screen boards).
+  void AttachNametableRAM(u8 *ram);
+
+  MirroringMode GetMirroring() const { return mirroring; }
+
+  // Where each nametable currently is: nametable (addr >> 10) & 3 starts at page[...].
+  u8 *const *GetNametablePages() const { return nametable_pages; }
+
+  const u8 *GetPRGROM() const { return PRG_ROM; }
+  u32 GetPRGROMSize() const { return 0x4000 * description.PRG_ROM_16KB_Multiple; }
+  const u8 *GetCHRROM() const { return CHR_ROM; }
+  u32 GetCHRROMSize() const { return 0x2000 * description.CHR_ROM_8KB_Multiple; }
 };
\ No newline at end of file
@@ -6,7 +6,9 @@ Console::Console()
     : bus(std::make_shared<Bus>()),
       cpu(std::make_shared<CPU>()),
       ppu(std::make_shared<PPU>()),
-      controllers(std::make_shared<Controllers>())
+      controllers(std::make_shared<Controllers>()),
+      cpu_clock_count(0),
+      frame_count(0)
 {
   // Everything get's a pointer to the bus
   cpu->SetBus(bus);
@@ -18,11 +20,29 @@ Console::Console()
   bus->SetControllers(controllers);
 }
 
-void Console::LoadROM(const char *path)
+RomLoadError Console::LoadROM(const char *path)
 {
-  this->cartridge = std::shared_ptr<Cartridge>(Cartridge::LoadRomFile(path));
+  Cartridge *loaded;
+  RomLoadError error = Cartridge::LoadRomFile(path, loaded);
+  return insert_cartridge(error, loaded);
+}
+
+RomLoadError Console::LoadROMFromMemory(const u8 *data, size_t size)
+{
+  Cartridge *loaded;
+  RomLoadError error = Cartridge::LoadRomFromMemory(data, size, loaded);
+  return insert_cartridge(error, loaded);
+}
+
+RomLoadError Console::insert_cartridge(RomLoadError error, Cartridge *loaded)
+{
+  if (error != RomLoadError::None)
+    return error;
+
+  this->cartridge = std::shared_ptr<Cartridge>(loaded);
   this->bus->SetCartridge(this->cartridge);
   this->ppu->SetCartridge(this->cartridge);
+  return RomLoadError::None;
 }
 
 void Console::HardReset()
@@ -38,10 +58,7 @@ int Console::StepCPU()
   int cpuCycles = cpu->Step();
   TraceEventEmitter::Instance()->Emit(cpu_step, "CPUStep");
 
-  for (int ppu_cycles = 0; ppu_cycles < 3 * cpuCycles; ++ppu_cycles)
-  {
-    ppu->Clock();
-  }
+  ppu->Run(3 * cpuCycles);
 
   return cpuCycles;
 }
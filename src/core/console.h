@@ -20,10 +20,15 @@ private:
   u64 cpu_clock_count;
   u32 frame_count;
 
+  RomLoadError insert_cartridge(RomLoadError error, Cartridge *loaded);
+
 public:
   Console();
 
-  void LoadROM(const char *file_path);
+  // Load a cartridge (see Cartridge::LoadRomFile() and LoadRomFromMemory()). On failure
+  // the console is left as it was.
+  RomLoadError LoadROM(const char *file_path);
+  RomLoadError LoadROMFromMemory(const u8 *data, size_t size);
   void HardReset();
   void SoftReset();
   void StepFrame();
@@ -36,7 +41,14 @@ public:
   u64 GetCPUClockCount() const { return cpu_clock_count; }
   u32 GetFrameCount() const { return frame_count; }
   Texture& GetFrameBuffer() { return ppu->GetFrameBufferTexture(); }
+  const u16 *GetIndexedFrameBuffer() { return ppu->GetIndexedFrameBuffer(); }
+
+  // Have the PPU write each frame straight into the caller's buffer (256x240 in 'format',
+  // rows 'pitch' bytes apart), e.g. a locked streaming texture or shared memory. Pass
+  // nullptr to stop. See PPU::SetFrameOutput().
+  void SetFrameOutput(void *pixels, int pitch, PixelFormat format) { ppu->SetFrameOutput(pixels, pitch, format); }
   std::shared_ptr<PPU> GetPPU() { return ppu; }
   std::shared_ptr<Controllers> GetControllers() { return controllers; }
   std::shared_ptr<Bus> GetBus() { return bus; }
+  std::shared_ptr<Cartridge> GetCartridge() { return cartridge; }
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "core/content_hash.h"
+#include <cstring>
+
+// Slicing-by-8: eight tables, so eight bytes are folded in per step.
+struct CRC32Tables
+{
+  u32 table[8][256];
+
+  constexpr CRC32Tables() : table()
+  {
+    for (u32 i = 0; i < 256; ++i)
+    {
+      u32 crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+        crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+      table[0][i] = crc;
+    }
+
+    for (u32 i = 0; i < 256; ++i)
+      for (int slice = 1; slice < 8; ++slice)
+        table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+  }
+};
+
+static constexpr CRC32Tables CRC32_TABLES{};
+
+u32 CRC32(const u8 *data, size_t size, u32 crc)
+{
+  const auto &t = CRC32_TABLES.table;
+  crc = ~crc;
+
+  for (; size >= 8; size -= 8, data += 8)
+  {
+    // Little-endian loads
+    const u32 low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((u32)data[3] << 24));
+    const u32 high = data[4] | (data[5] << 8) | (data[6] << 16) | ((u32)data[7] << 24);
+    crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+          t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+  }
+
+  for (; size > 0; --size, ++data)
+    crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+
+  return ~crc;
+}
+
+static u32 rotl32(u32 x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+// One 64-byte block of SHA-1 (FIPS 180-4)
+static void sha1_block(u32 state[5], const u8 *block)
+{
+  u32 w[80];
+  for (int i = 0; i < 16; ++i)
+    w[i] = ((u32)block[4 * i] << 24) | (block[4 * i + 1] << 16) | (block[4 * i + 2] << 8) | block[4 * i + 3];
+  for (int i = 16; i < 80; ++i)
+    w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  u32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+  for (int i = 0; i < 80; ++i)
+  {
+    u32 f, k;
+    if (i < 20)
+    {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    }
+    else if (i < 40)
+    {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    }
+    else if (i < 60)
+    {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    }
+    else
+    {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+
+    const u32 temp = rotl32(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rotl32(b, 30);
+    b = a;
+    a = temp;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+void SHA1(const u8 *first, size_t first_size, const u8 *second, size_t second_size, u8 digest[20])
+{
+  u32 state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  u8 block[64];
+  size_t filled = 0;
+
+  // Whole blocks straight from the input; only blocks that straddle the two pieces (or
+  // the end) are put together in 'block'.
+  const u8 *pieces[2] = {first, second};
+  const size_t sizes[2] = {first_size, second_size};
+  for (int piece = 0; piece < 2; ++piece)
+  {
+    const u8 *data = pieces[piece];
+    size_t size = sizes[piece];
+
+    if (filled)
+    {
+      const size_t take = size < 64 - filled ? size : 64 - filled;
+      memcpy(block + filled, data, take);
+      filled += take;
+      data += take;
+      size -= take;
+      if (filled < 64)
+        continue;
+      sha1_block(state, block);
+      filled = 0;
+    }
+
+    for (; size >= 64; size -= 64, data += 64)
+      sha1_block(state, data);
+
+    memcpy(block, data, size);
+    filled = size;
+  }
+
+  // Padding: a one bit, zeros, then the message length in bits.
+  const u64 bits = 8 * (u64)(first_size + second_size);
+  block[filled++] = 0x80;
+  if (filled > 56)
+  {
+    memset(block + filled, 0, 64 - filled);
+    sha1_block(state, block);
+    filled = 0;
+  }
+  memset(block + filled, 0, 56 - filled);
+  for (int i = 0; i < 8; ++i)
+    block[56 + i] = bits >> (56 - 8 * i);
+  sha1_block(state, block);
+
+  for (int i = 0; i < 5; ++i)
+  {
+    digest[4 * i] = state[i] >> 24;
+    digest[4 * i + 1] = state[i] >> 16;
+    digest[4 * i + 2] = state[i] >> 8;
+    digest[4 * i + 3] = state[i];
+  }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include "core/types.h"
+
+// The hashes ROM databases identify dumps by, over PRG-ROM followed by CHR-ROM.
+
+// CRC-32 (as in zip and PNG) of 'size' bytes. Pass the previous result as 'crc' to continue
+// a CRC over several pieces.
+u32 CRC32(const u8 *data, size_t size, u32 crc = 0);
+
+// SHA-1 of a message made of up to two pieces, e.g. PRG-ROM and CHR-ROM.
+void SHA1(const u8 *first, size_t first_size, const u8 *second, size_t second_size, u8 digest[20]);
@@ -22,5 +22,6 @@ public:
 
   void StrobeJoyPad(u8 val);
   u8 ShiftJoyPadBit(u8 index);
+  u8 PeekJoyPadBit(u8 index) const { return controller_shift_registers[index] & 1; }
   void SetButtonPressed(u8 controller_index, ButtonMask button, bool pressed);
 };
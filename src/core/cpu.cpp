@@ -1,3 +1,4 @@
+#include <array>
 #include <functional>
 #include <string>
 
@@ -14,240 +15,249 @@
 // instructions are in flight. This should be close to cycle-accurate
 // as a result.
 
-CPU::CPU()
+// The opcode table is the same for every CPU, so it is built once at compile time rather
+// than per instance.
+constexpr std::array<CPU::InstructionEntry, 256> CPU::build_instruction_table()
 {
-  total_clock_cycles = 0;
-  instruction_remaining_cycles = 0;
-  a = x = y = p = 0;
-  oam_dma_cycles_remaining = 0;
-
-  instructions.clear();
+  std::array<InstructionEntry, 256> table{};
   for (int i = 0; i < 256; ++i)
   {
-    instructions.push_back({"???", &CPU::NOP, &CPU::addr_implied, 2});
+    table[i] = {"???", &CPU::NOP, &CPU::addr_implied, 2};
   }
 
   // ADC
-  instructions[0x69] = {"ADC", &CPU::ADC, &CPU::addr_immediate, 2};
-  instructions[0x65] = {"ADC", &CPU::ADC, &CPU::addr_zeropage, 3};
-  instructions[0x75] = {"ADC", &CPU::ADC, &CPU::addr_zeropage_x, 4};
-  instructions[0x6D] = {"ADC", &CPU::ADC, &CPU::addr_absolute, 4};
-  instructions[0x7D] = {"ADC", &CPU::ADC, &CPU::addr_absolute_x, 4};
-  instructions[0x79] = {"ADC", &CPU::ADC, &CPU::addr_absolute_y, 4};
-  instructions[0x61] = {"ADC", &CPU::ADC, &CPU::addr_indirect_x, 6};
-  instructions[0x71] = {"ADC", &CPU::ADC, &CPU::addr_indirect_y, 5};
+  table[0x69] = {"ADC", &CPU::ADC, &CPU::addr_immediate, 2};
+  table[0x65] = {"ADC", &CPU::ADC, &CPU::addr_zeropage, 3};
+  table[0x75] = {"ADC", &CPU::ADC, &CPU::addr_zeropage_x, 4};
+  table[0x6D] = {"ADC", &CPU::ADC, &CPU::addr_absolute, 4};
+  table[0x7D] = {"ADC", &CPU::ADC, &CPU::addr_absolute_x, 4};
+  table[0x79] = {"ADC", &CPU::ADC, &CPU::addr_absolute_y, 4};
+  table[0x61] = {"ADC", &CPU::ADC, &CPU::addr_indirect_x, 6};
+  table[0x71] = {"ADC", &CPU::ADC, &CPU::addr_indirect_y, 5};
 
   // AND
-  instructions[0x29] = {"AND", &CPU::AND, &CPU::addr_immediate, 2};
-  instructions[0x25] = {"AND", &CPU::AND, &CPU::addr_zeropage, 3};
-  instructions[0x35] = {"AND", &CPU::AND, &CPU::addr_zeropage_x, 4};
-  instructions[0x2D] = {"AND", &CPU::AND, &CPU::addr_absolute, 4};
-  instructions[0x3D] = {"AND", &CPU::AND, &CPU::addr_absolute_x, 4};
-  instructions[0x39] = {"AND", &CPU::AND, &CPU::addr_absolute_y, 4};
-  instructions[0x21] = {"AND", &CPU::AND, &CPU::addr_indirect_x, 6};
-  instructions[0x31] = {"AND", &CPU::AND, &CPU::addr_indirect_y, 5};
+  table[0x29] = {"AND", &CPU::AND, &CPU::addr_immediate, 2};
+  table[0x25] = {"AND", &CPU::AND, &CPU::addr_zeropage, 3};
+  table[0x35] = {"AND", &CPU::AND, &CPU::addr_zeropage_x, 4};
+  table[0x2D] = {"AND", &CPU::AND, &CPU::addr_absolute, 4};
+  table[0x3D] = {"AND", &CPU::AND, &CPU::addr_absolute_x, 4};
+  table[0x39] = {"AND", &CPU::AND, &CPU::addr_absolute_y, 4};
+  table[0x21] = {"AND", &CPU::AND, &CPU::addr_indirect_x, 6};
+  table[0x31] = {"AND", &CPU::AND, &CPU::addr_indirect_y, 5};
 
   // ASL
-  instructions[0x0A] = {"ASL", &CPU::ASL, &CPU::addr_implied, 2};
-  instructions[0x06] = {"ASL", &CPU::ASL, &CPU::addr_zeropage, 5};
-  instructions[0x16] = {"ASL", &CPU::ASL, &CPU::addr_zeropage_x, 6};
-  instructions[0x0E] = {"ASL", &CPU::ASL, &CPU::addr_absolute, 6};
-  instructions[0x1E] = {"ASL", &CPU::ASL, &CPU::addr_absolute_x, 7};
+  table[0x0A] = {"ASL", &CPU::ASL, &CPU::addr_implied, 2};
+  table[0x06] = {"ASL", &CPU::ASL, &CPU::addr_zeropage, 5};
+  table[0x16] = {"ASL", &CPU::ASL, &CPU::addr_zeropage_x, 6};
+  table[0x0E] = {"ASL", &CPU::ASL, &CPU::addr_absolute, 6};
+  table[0x1E] = {"ASL", &CPU::ASL, &CPU::addr_absolute_x, 7};
 
   // BIT
-  instructions[0x24] = {"BIT", &CPU::BIT, &CPU::addr_zeropage, 3};
-  instructions[0x2C] = {"BIT", &CPU::BIT, &CPU::addr_absolute, 4};
+  table[0x24] = {"BIT", &CPU::BIT, &CPU::addr_zeropage, 3};
+  table[0x2C] = {"BIT", &CPU::BIT, &CPU::addr_absolute, 4};
 
   // Branch instructions
-  instructions[0x10] = {"BPL", &CPU::BPL, &CPU::addr_relative, 2};
-  instructions[0x30] = {"BMI", &CPU::BMI, &CPU::addr_relative, 2};
-  instructions[0x50] = {"BVC", &CPU::BVC, &CPU::addr_relative, 2};
-  instructions[0x70] = {"BVS", &CPU::BVS, &CPU::addr_relative, 2};
-  instructions[0x90] = {"BCC", &CPU::BCC, &CPU::addr_relative, 2};
-  instructions[0xB0] = {"BCS", &CPU::BCS, &CPU::addr_relative, 2};
-  instructions[0xD0] = {"BNE", &CPU::BNE, &CPU::addr_relative, 2};
-  instructions[0xF0] = {"BEQ", &CPU::BEQ, &CPU::addr_relative, 2};
+  table[0x10] = {"BPL", &CPU::BPL, &CPU::addr_relative, 2};
+  table[0x30] = {"BMI", &CPU::BMI, &CPU::addr_relative, 2};
+  table[0x50] = {"BVC", &CPU::BVC, &CPU::addr_relative, 2};
+  table[0x70] = {"BVS", &CPU::BVS, &CPU::addr_relative, 2};
+  table[0x90] = {"BCC", &CPU::BCC, &CPU::addr_relative, 2};
+  table[0xB0] = {"BCS", &CPU::BCS, &CPU::addr_relative, 2};
+  table[0xD0] = {"BNE", &CPU::BNE, &CPU::addr_relative, 2};
+  table[0xF0] = {"BEQ", &CPU::BEQ, &CPU::addr_relative, 2};
 
   // BRK
-  instructions[0x00] = {"BRK", &CPU::BRK, &CPU::addr_implied, 7};
+  table[0x00] = {"BRK", &CPU::BRK, &CPU::addr_implied, 7};
 
   // CMP
-  instructions[0xC9] = {"CMP", &CPU::CMP, &CPU::addr_immediate, 2};
-  instructions[0xC5] = {"CMP", &CPU::CMP, &CPU::addr_zeropage, 3};
-  instructions[0xD5] = {"CMP", &CPU::CMP, &CPU::addr_zeropage_x, 4};
-  instructions[0xCD] = {"CMP", &CPU::CMP, &CPU::addr_absolute, 4};
-  instructions[0xDD] = {"CMP", &CPU::CMP, &CPU::addr_absolute_x, 4};
-  instructions[0xD9] = {"CMP", &CPU::CMP, &CPU::addr_absolute_y, 4};
-  instructions[0xC1] = {"CMP", &CPU::CMP, &CPU::addr_indirect_x, 6};
-  instructions[0xD1] = {"CMP", &CPU::CMP, &CPU::addr_indirect_y, 5};
+  table[0xC9] = {"CMP", &CPU::CMP, &CPU::addr_immediate, 2};
+  table[0xC5] = {"CMP", &CPU::CMP, &CPU::addr_zeropage, 3};
+  table[0xD5] = {"CMP", &CPU::CMP, &CPU::addr_zeropage_x, 4};
+  table[0xCD] = {"CMP", &CPU::CMP, &CPU::addr_absolute, 4};
+  table[0xDD] = {"CMP", &CPU::CMP, &CPU::addr_absolute_x, 4};
+  table[0xD9] = {"CMP", &CPU::CMP, &CPU::addr_absolute_y, 4};
+  table[0xC1] = {"CMP", &CPU::CMP, &CPU::addr_indirect_x, 6};
+  table[0xD1] = {"CMP", &CPU::CMP, &CPU::addr_indirect_y, 5};
 
   // CPX
-  instructions[0xE0] = {"CPX", &CPU::CPX, &CPU::addr_immediate, 2};
-  instructions[0xE4] = {"CPX", &CPU::CPX, &CPU::addr_zeropage, 3};
-  instructions[0xEC] = {"CPX", &CPU::CPX, &CPU::addr_absolute, 4};
+  table[0xE0] = {"CPX", &CPU::CPX, &CPU::addr_immediate, 2};
+  table[0xE4] = {"CPX", &CPU::CPX, &CPU::addr_zeropage, 3};
+  table[0xEC] = {"CPX", &CPU::CPX, &CPU::addr_absolute, 4};
 
   // CPY
-  instructions[0xC0] = {"CPY", &CPU::CPY, &CPU::addr_immediate, 2};
-  instructions[0xC4] = {"CPY", &CPU::CPY, &CPU::addr_zeropage, 3};
-  instructions[0xCC] = {"CPY", &CPU::CPY, &CPU::addr_absolute, 4};
+  table[0xC0] = {"CPY", &CPU::CPY, &CPU::addr_immediate, 2};
+  table[0xC4] = {"CPY", &CPU::CPY, &CPU::addr_zeropage, 3};
+  table[0xCC] = {"CPY", &CPU::CPY, &CPU::addr_absolute, 4};
 
   // DEC
-  instructions[0xC6] = {"DEC", &CPU::DEC, &CPU::addr_zeropage, 5};
-  instructions[0xD6] = {"DEC", &CPU::DEC, &CPU::addr_zeropage_x, 6};
-  instructions[0xCE] = {"DEC", &CPU::DEC, &CPU::addr_absolute, 6};
-  instructions[0xDE] = {"DEC", &CPU::DEC, &CPU::addr_absolute_x, 7};
+  table[0xC6] = {"DEC", &CPU::DEC, &CPU::addr_zeropage, 5};
+  table[0xD6] = {"DEC", &CPU::DEC, &CPU::addr_zeropage_x, 6};
+  table[0xCE] = {"DEC", &CPU::DEC, &CPU::addr_absolute, 6};
+  table[0xDE] = {"DEC", &CPU::DEC, &CPU::addr_absolute_x, 7};
 
   // EOR
-  instructions[0x49] = {"EOR", &CPU::EOR, &CPU::addr_immediate, 2};
-  instructions[0x45] = {"EOR", &CPU::EOR, &CPU::addr_zeropage, 3};
-  instructions[0x55] = {"EOR", &CPU::EOR, &CPU::addr_zeropage_x, 4};
-  instructions[0x4D] = {"EOR", &CPU::EOR, &CPU::addr_absolute, 4};
-  instructions[0x5D] = {"EOR", &CPU::EOR, &CPU::addr_absolute_x, 4};
-  instructions[0x59] = {"EOR", &CPU::EOR, &CPU::addr_absolute_y, 5};
-  instructions[0x41] = {"EOR", &CPU::EOR, &CPU::addr_indirect_x, 6};
-  instructions[0x51] = {"EOR", &CPU::EOR, &CPU::addr_indirect_y, 5};
+  table[0x49] = {"EOR", &CPU::EOR, &CPU::addr_immediate, 2};
+  table[0x45] = {"EOR", &CPU::EOR, &CPU::addr_zeropage, 3};
+  table[0x55] = {"EOR", &CPU::EOR, &CPU::addr_zeropage_x, 4};
+  table[0x4D] = {"EOR", &CPU::EOR, &CPU::addr_absolute, 4};
+  table[0x5D] = {"EOR", &CPU::EOR, &CPU::addr_absolute_x, 4};
+  table[0x59] = {"EOR", &CPU::EOR, &CPU::addr_absolute_y, 5};
+  table[0x41] = {"EOR", &CPU::EOR, &CPU::addr_indirect_x, 6};
+  table[0x51] = {"EOR", &CPU::EOR, &CPU::addr_indirect_y, 5};
 
   // Flag instructions
-  instructions[0x18] = {"CLC", &CPU::CLC, &CPU::addr_implied, 2};
-  instructions[0x38] = {"SEC", &CPU::SEC, &CPU::addr_implied, 2};
-  instructions[0x58] = {"CLI", &CPU::CLI, &CPU::addr_implied, 2};
-  instructions[0x78] = {"SEI", &CPU::SEI, &CPU::addr_implied, 2};
-  instructions[0xB8] = {"CLV", &CPU::CLV, &CPU::addr_implied, 2};
-  instructions[0xD8] = {"CLD", &CPU::CLD, &CPU::addr_implied, 2};
-  instructions[0xF8] = {"SED", &CPU::SED, &CPU::addr_implied, 2};
+  table[0x18] = {"CLC", &CPU::CLC, &CPU::addr_implied, 2};
+  table[0x38] = {"SEC", &CPU::SEC, &CPU::addr_implied, 2};
+  table[0x58] = {"CLI", &CPU::CLI, &CPU::addr_implied, 2};
+  table[0x78] = {"SEI", &CPU::SEI, &CPU::addr_implied, 2};
+  table[0xB8] = {"CLV", &CPU::CLV, &CPU::addr_implied, 2};
+  table[0xD8] = {"CLD", &CPU::CLD, &CPU::addr_implied, 2};
+  table[0xF8] = {"SED", &CPU::SED, &CPU::addr_implied, 2};
 
   // INC
-  instructions[0xE6] = {"INC", &CPU::INC, &CPU::addr_zeropage, 5};
-  instructions[0xF6] = {"INC", &CPU::INC, &CPU::addr_zeropage_x, 6};
-  instructions[0xEE] = {"INC", &CPU::INC, &CPU::addr_absolute, 6};
-  instructions[0xFE] = {"INC", &CPU::INC, &CPU::addr_absolute_x, 7};
+  table[0xE6] = {"INC", &CPU::INC, &CPU::addr_zeropage, 5};
+  table[0xF6] = {"INC", &CPU::INC, &CPU::addr_zeropage_x, 6};
+  table[0xEE] = {"INC", &CPU::INC, &CPU::addr_absolute, 6};
+  table[0xFE] = {"INC", &CPU::INC, &CPU::addr_absolute_x, 7};
 
   // JMP
-  instructions[0x4C] = {"JMP", &CPU::JMP, &CPU::addr_absolute, 3};
-  instructions[0x6C] = {"JMP", &CPU::JMP, &CPU::addr_indirect, 5};
+  table[0x4C] = {"JMP", &CPU::JMP, &CPU::addr_absolute, 3};
+  table[0x6C] = {"JMP", &CPU::JMP, &CPU::addr_indirect, 5};
 
   // JSR
-  instructions[0x20] = {"JSR", &CPU::JSR, &CPU::addr_absolute, 6};
+  table[0x20] = {"JSR", &CPU::JSR, &CPU::addr_absolute, 6};
 
   // LDA
-  instructions[0xA9] = {"LDA", &CPU::LDA, &CPU::addr_immediate, 2};
-  instructions[0xA5] = {"LDA", &CPU::LDA, &CPU::addr_zeropage, 3};
-  instructions[0xB5] = {"LDA", &CPU::LDA, &CPU::addr_zeropage_x, 4};
-  instructions[0xAD] = {"LDA", &CPU::LDA, &CPU::addr_absolute, 4};
-  instructions[0xBD] = {"LDA", &CPU::LDA, &CPU::addr_absolute_x, 4};
-  instructions[0xB9] = {"LDA", &CPU::LDA, &CPU::addr_absolute_y, 4};
-  instructions[0xA1] = {"LDA", &CPU::LDA, &CPU::addr_indirect_x, 6};
-  instructions[0xB1] = {"LDA", &CPU::LDA, &CPU::addr_indirect_y, 5};
+  table[0xA9] = {"LDA", &CPU::LDA, &CPU::addr_immediate, 2};
+  table[0xA5] = {"LDA", &CPU::LDA, &CPU::addr_zeropage, 3};
+  table[0xB5] = {"LDA", &CPU::LDA, &CPU::addr_zeropage_x, 4};
+  table[0xAD] = {"LDA", &CPU::LDA, &CPU::addr_absolute, 4};
+  table[0xBD] = {"LDA", &CPU::LDA, &CPU::addr_absolute_x, 4};
+  table[0xB9] = {"LDA", &CPU::LDA, &CPU::addr_absolute_y, 4};
+  table[0xA1] = {"LDA", &CPU::LDA, &CPU::addr_indirect_x, 6};
+  table[0xB1] = {"LDA", &CPU::LDA, &CPU::addr_indirect_y, 5};
 
   // LDX
-  instructions[0xA2] = {"LDX", &CPU::LDX, &CPU::addr_immediate, 2};
-  instructions[0xA6] = {"LDX", &CPU::LDX, &CPU::addr_zeropage, 3};
-  instructions[0xB6] = {"LDX", &CPU::LDX, &CPU::addr_zeropage_y, 4};
-  instructions[0xAE] = {"LDX", &CPU::LDX, &CPU::addr_absolute, 4};
-  instructions[0xBE] = {"LDX", &CPU::LDX, &CPU::addr_absolute_y, 4};
+  table[0xA2] = {"LDX", &CPU::LDX, &CPU::addr_immediate, 2};
+  table[0xA6] = {"LDX", &CPU::LDX, &CPU::addr_zeropage, 3};
+  table[0xB6] = {"LDX", &CPU::LDX, &CPU::addr_zeropage_y, 4};
+  table[0xAE] = {"LDX", &CPU::LDX, &CPU::addr_absolute, 4};
+  table[0xBE] = {"LDX", &CPU::LDX, &CPU::addr_absolute_y, 4};
 
   // LDY
-  instructions[0xA0] = {"LDY", &CPU::LDY, &CPU::addr_immediate, 2};
-  instructions[0xA4] = {"LDY", &CPU::LDY, &CPU::addr_zeropage, 3};
-  instructions[0xB4] = {"LDY", &CPU::LDY, &CPU::addr_zeropage_x, 4};
-  instructions[0xAC] = {"LDY", &CPU::LDY, &CPU::addr_absolute, 4};
-  instructions[0xBC] = {"LDY", &CPU::LDY, &CPU::addr_absolute_x, 4};
+  table[0xA0] = {"LDY", &CPU::LDY, &CPU::addr_immediate, 2};
+  table[0xA4] = {"LDY", &CPU::LDY, &CPU::addr_zeropage, 3};
+  table[0xB4] = {"LDY", &CPU::LDY, &CPU::addr_zeropage_x, 4};
+  table[0xAC] = {"LDY", &CPU::LDY, &CPU::addr_absolute, 4};
+  table[0xBC] = {"LDY", &CPU::LDY, &CPU::addr_absolute_x, 4};
 
   // LSR
-  instructions[0x4A] = {"LSR", &CPU::LSR, &CPU::addr_implied, 2};
-  instructions[0x46] = {"LSR", &CPU::LSR, &CPU::addr_zeropage, 5};
-  instructions[0x56] = {"LSR", &CPU::LSR, &CPU::addr_zeropage_x, 6};
-  instructions[0x4E] = {"LSR", &CPU::LSR, &CPU::addr_absolute, 6};
-  instructions[0x5E] = {"LSR", &CPU::LSR, &CPU::addr_absolute_x, 7};
+  table[0x4A] = {"LSR", &CPU::LSR, &CPU::addr_implied, 2};
+  table[0x46] = {"LSR", &CPU::LSR, &CPU::addr_zeropage, 5};
+  table[0x56] = {"LSR", &CPU::LSR, &CPU::addr_zeropage_x, 6};
+  table[0x4E] = {"LSR", &CPU::LSR, &CPU::addr_absolute, 6};
+  table[0x5E] = {"LSR", &CPU::LSR, &CPU::addr_absolute_x, 7};
 
   // NOP
-  instructions[0xDA] = {"NOP", &CPU::NOP, &CPU::addr_implied, 2};
-  instructions[0xEA] = {"NOP", &CPU::NOP, &CPU::addr_implied, 2};
-  instructions[0xFA] = {"NOP", &CPU::NOP, &CPU::addr_implied, 2};
+  table[0xDA] = {"NOP", &CPU::NOP, &CPU::addr_implied, 2};
+  table[0xEA] = {"NOP", &CPU::NOP, &CPU::addr_implied, 2};
+  table[0xFA] = {"NOP", &CPU::NOP, &CPU::addr_implied, 2};
 
   // ORA
-  instructions[0x09] = {"ORA", &CPU::ORA, &CPU::addr_immediate, 2};
-  instructions[0x05] = {"ORA", &CPU::ORA, &CPU::addr_zeropage, 3};
-  instructions[0x15] = {"ORA", &CPU::ORA, &CPU::addr_zeropage_x, 4};
-  instructions[0x0D] = {"ORA", &CPU::ORA, &CPU::addr_absolute, 4};
-  instructions[0x1D] = {"ORA", &CPU::ORA, &CPU::addr_absolute_x, 4};
-  instructions[0x19] = {"ORA", &CPU::ORA, &CPU::addr_absolute_y, 4};
-  instructions[0x01] = {"ORA", &CPU::ORA, &CPU::addr_indirect_x, 6};
-  instructions[0x11] = {"ORA", &CPU::ORA, &CPU::addr_indirect_y, 5};
+  table[0x09] = {"ORA", &CPU::ORA, &CPU::addr_immediate, 2};
+  table[0x05] = {"ORA", &CPU::ORA, &CPU::addr_zeropage, 3};
+  table[0x15] = {"ORA", &CPU::ORA, &CPU::addr_zeropage_x, 4};
+  table[0x0D] = {"ORA", &CPU::ORA, &CPU::addr_absolute, 4};
+  table[0x1D] = {"ORA", &CPU::ORA, &CPU::addr_absolute_x, 4};
+  table[0x19] = {"ORA", &CPU::ORA, &CPU::addr_absolute_y, 4};
+  table[0x01] = {"ORA", &CPU::ORA, &CPU::addr_indirect_x, 6};
+  table[0x11] = {"ORA", &CPU::ORA, &CPU::addr_indirect_y, 5};
 
   // Register instructions
-  instructions[0xAA] = {"TAX", &CPU::TAX, &CPU::addr_implied, 2};
-  instructions[0x8A] = {"TXA", &CPU::TXA, &CPU::addr_implied, 2};
-  instructions[0xCA] = {"DEX", &CPU::DEX, &CPU::addr_implied, 2};
-  instructions[0xE8] = {"INX", &CPU::INX, &CPU::addr_implied, 2};
-  instructions[0xA8] = {"TAY", &CPU::TAY, &CPU::addr_implied, 2};
-  instructions[0x98] = {"TYA", &CPU::TYA, &CPU::addr_implied, 2};
-  instructions[0x88] = {"DEY", &CPU::DEY, &CPU::addr_implied, 2};
-  instructions[0xC8] = {"INY", &CPU::INY, &CPU::addr_implied, 2};
+  table[0xAA] = {"TAX", &CPU::TAX, &CPU::addr_implied, 2};
+  table[0x8A] = {"TXA", &CPU::TXA, &CPU::addr_implied, 2};
+  table[0xCA] = {"DEX", &CPU::DEX, &CPU::addr_implied, 2};
+  table[0xE8] = {"INX", &CPU::INX, &CPU::addr_implied, 2};
+  table[0xA8] = {"TAY", &CPU::TAY, &CPU::addr_implied, 2};
+  table[0x98] = {"TYA", &CPU::TYA, &CPU::addr_implied, 2};
+  table[0x88] = {"DEY", &CPU::DEY, &CPU::addr_implied, 2};
+  table[0xC8] = {"INY", &CPU::INY, &CPU::addr_implied, 2};
 
   // ROL
-  instructions[0x2A] = {"ROL", &CPU::ROL, &CPU::addr_implied, 2};
-  instructions[0x26] = {"ROL", &CPU::ROL, &CPU::addr_zeropage, 5};
-  instructions[0x36] = {"ROL", &CPU::ROL, &CPU::addr_zeropage_x, 6};
-  instructions[0x2E] = {"ROL", &CPU::ROL, &CPU::addr_absolute, 6};
-  instructions[0x3E] = {"ROL", &CPU::ROL, &CPU::addr_absolute_x, 7};
+  table[0x2A] = {"ROL", &CPU::ROL, &CPU::addr_implied, 2};
+  table[0x26] = {"ROL", &CPU::ROL, &CPU::addr_zeropage, 5};
+  table[0x36] = {"ROL", &CPU::ROL, &CPU::addr_zeropage_x, 6};
+  table[0x2E] = {"ROL", &CPU::ROL, &CPU::addr_absolute, 6};
+  table[0x3E] = {"ROL", &CPU::ROL, &CPU::addr_absolute_x, 7};
 
   // ROR
-  instructions[0x6A] = {"ROR", &CPU::ROR, &CPU::addr_implied, 2};
-  instructions[0x66] = {"ROR", &CPU::ROR, &CPU::addr_zeropage, 5};
-  instructions[0x76] = {"ROR", &CPU::ROR, &CPU::addr_zeropage_x, 6};
-  instructions[0x6E] = {"ROR", &CPU::ROR, &CPU::addr_absolute, 6};
-  instructions[0x7E] = {"ROR", &CPU::ROR, &CPU::addr_absolute_x, 7};
+  table[0x6A] = {"ROR", &CPU::ROR, &CPU::addr_implied, 2};
+  table[0x66] = {"ROR", &CPU::ROR, &CPU::addr_zeropage, 5};
+  table[0x76] = {"ROR", &CPU::ROR, &CPU::addr_zeropage_x, 6};
+  table[0x6E] = {"ROR", &CPU::ROR, &CPU::addr_absolute, 6};
+  table[0x7E] = {"ROR", &CPU::ROR, &CPU::addr_absolute_x, 7};
 
   // RTI
-  instructions[0x40] = {"RTI", &CPU::RTI, &CPU::addr_implied, 6};
+  table[0x40] = {"RTI", &CPU::RTI, &CPU::addr_implied, 6};
 
   // RTS
-  instructions[0x60] = {"RTS", &CPU::RTS, &CPU::addr_implied, 6};
+  table[0x60] = {"RTS", &CPU::RTS, &CPU::addr_implied, 6};
 
   // SBC
-  instructions[0xE9] = {"SBC", &CPU::SBC, &CPU::addr_immediate, 2};
-  instructions[0xE5] = {"SBC", &CPU::SBC, &CPU::addr_zeropage, 3};
-  instructions[0xF5] = {"SBC", &CPU::SBC, &CPU::addr_zeropage_x, 4};
-  instructions[0xED] = {"SBC", &CPU::SBC, &CPU::addr_absolute, 4};
-  instructions[0xFD] = {"SBC", &CPU::SBC, &CPU::addr_absolute_x, 4};
-  instructions[0xF9] = {"SBC", &CPU::SBC, &CPU::addr_absolute_y, 4};
-  instructions[0xE1] = {"SBC", &CPU::SBC, &CPU::addr_indirect_x, 6};
-  instructions[0xF1] = {"SBC", &CPU::SBC, &CPU::addr_indirect_y, 5};
+  table[0xE9] = {"SBC", &CPU::SBC, &CPU::addr_immediate, 2};
+  table[0xE5] = {"SBC", &CPU::SBC, &CPU::addr_zeropage, 3};
+  table[0xF5] = {"SBC", &CPU::SBC, &CPU::addr_zeropage_x, 4};
+  table[0xED] = {"SBC", &CPU::SBC, &CPU::addr_absolute, 4};
+  table[0xFD] = {"SBC", &CPU::SBC, &CPU::addr_absolute_x, 4};
+  table[0xF9] = {"SBC", &CPU::SBC, &CPU::addr_absolute_y, 4};
+  table[0xE1] = {"SBC", &CPU::SBC, &CPU::addr_indirect_x, 6};
+  table[0xF1] = {"SBC", &CPU::SBC, &CPU::addr_indirect_y, 5};
 
   // STA
-  instructions[0x85] = {"STA", &CPU::STA, &CPU::addr_zeropage, 3};
-  instructions[0x95] = {"STA", &CPU::STA, &CPU::addr_zeropage_x, 4};
-  instructions[0x8D] = {"STA", &CPU::STA, &CPU::addr_absolute, 4};
-  instructions[0x9D] = {"STA", &CPU::STA, &CPU::addr_absolute_x, 5};
-  instructions[0x99] = {"STA", &CPU::STA, &CPU::addr_absolute_y, 5};
-  instructions[0x81] = {"STA", &CPU::STA, &CPU::addr_indirect_x, 6};
-  instructions[0x91] = {"STA", &CPU::STA, &CPU::addr_indirect_y, 6};
+  table[0x85] = {"STA", &CPU::STA, &CPU::addr_zeropage, 3};
+  table[0x95] = {"STA", &CPU::STA, &CPU::addr_zeropage_x, 4};
+  table[0x8D] = {"STA", &CPU::STA, &CPU::addr_absolute, 4};
+  table[0x9D] = {"STA", &CPU::STA, &CPU::addr_absolute_x, 5};
+  table[0x99] = {"STA", &CPU::STA, &CPU::addr_absolute_y, 5};
+  table[0x81] = {"STA", &CPU::STA, &CPU::addr_indirect_x, 6};
+  table[0x91] = {"STA", &CPU::STA, &CPU::addr_indirect_y, 6};
 
   // Stack instructions
-  instructions[0x9A] = {"TXS", &CPU::TXS, &CPU::addr_implied, 2};
-  instructions[0xBA] = {"TSX", &CPU::TSX, &CPU::addr_implied, 2};
-  instructions[0x48] = {"PHA", &CPU::PHA, &CPU::addr_implied, 3};
-  instructions[0x68] = {"PLA", &CPU::PLA, &CPU::addr_implied, 4};
-  instructions[0x08] = {"PHP", &CPU::PHP, &CPU::addr_implied, 3};
-  instructions[0x28] = {"PLP", &CPU::PLP, &CPU::addr_implied, 4};
+  table[0x9A] = {"TXS", &CPU::TXS, &CPU::addr_implied, 2};
+  table[0xBA] = {"TSX", &CPU::TSX, &CPU::addr_implied, 2};
+  table[0x48] = {"PHA", &CPU::PHA, &CPU::addr_implied, 3};
+  table[0x68] = {"PLA", &CPU::PLA, &CPU::addr_implied, 4};
+  table[0x08] = {"PHP", &CPU::PHP, &CPU::addr_implied, 3};
+  table[0x28] = {"PLP", &CPU::PLP, &CPU::addr_implied, 4};
 
   // STX
-  instructions[0x86] = {"STX", &CPU::STX, &CPU::addr_zeropage, 3};
-  instructions[0x96] = {"STX", &CPU::STX, &CPU::addr_zeropage_y, 4};
-  instructions[0x8E] = {"STX", &CPU::STX, &CPU::addr_absolute, 4};
+  table[0x86] = {"STX", &CPU::STX, &CPU::addr_zeropage, 3};
+  table[0x96] = {"STX", &CPU::STX, &CPU::addr_zeropage_y, 4};
+  table[0x8E] = {"STX", &CPU::STX, &CPU::addr_absolute, 4};
 
   // STY
-  instructions[0x84] = {"STY", &CPU::STY, &CPU::addr_zeropage, 3};
-  instructions[0x94] = {"STY", &CPU::STY, &CPU::addr_zeropage_x, 4};
-  instructions[0x8C] = {"STY", &CPU::STY, &CPU::addr_absolute, 4};
+  table[0x84] = {"STY", &CPU::STY, &CPU::addr_zeropage, 3};
+  table[0x94] = {"STY", &CPU::STY, &CPU::addr_zeropage_x, 4};
+  table[0x8C] = {"STY", &CPU::STY, &CPU::addr_absolute, 4};
+
+  return table;
+}
 
+const std::array<CPU::InstructionEntry, 256> CPU::instructions = CPU::build_instruction_table();
+
+CPU::CPU()
+{
+  static_assert(build_instruction_table()[0xEA].cycles == 2, "opcode table must be a constant expression");
+
+  total_clock_cycles = 0;
+  instruction_remaining_cycles = 0;
+  a = x = y = p = 0;
+  oam_dma_cycles_remaining = 0;
   in_step_mode = false;
 }
 
 CPU::~CPU()
 {
-  printf("CPU Destroyed!\n");
 }
 
 void CPU::Pause()
@@ -897,7 +907,14 @@ u8 CPU::read(u16 addr, u8 rw_flags)
   else
   {
     m_stepmode = true;
-    return bus->Read(addr);
+    u8 val = bus->Read(addr);
+
+    // Watchpoints stop the CPU once the current instruction has finished.
+    if (debug_state.IsArmed(addr, Breakpoint::READ) && !watchpoints_suppressed)
+      if (breakpoint_condition_holds(addr, Breakpoint::READ, val))
+        in_step_mode = true;
+
+    return val;
   }
 }
 
@@ -905,6 +922,34 @@ void CPU::write(u16 addr, u8 val, u8 rw_flags)
 {
   bus->SetLastRAMWritePC(addr, opcode_pc);
   bus->Write(addr, val);
+
+  if (debug_state.IsArmed(addr, Breakpoint::WRITE) && !(rw_flags & RWFLAGS_NO_BREAKPOINTS))
+    if (breakpoint_condition_holds(addr, Breakpoint::WRITE, val))
+      in_step_mode = true;
+}
+
+static u8 peek_bus(void *bus, u16 addr)
+{
+  return ((Bus *)bus)->Read(addr, false);
+}
+
+bool CPU::breakpoint_condition_holds(u16 addr, u8 kind, u8 value)
+{
+  BreakpointContext ctx;
+  ctx.vars[BreakpointContext::A] = a;
+  ctx.vars[BreakpointContext::X] = x;
+  ctx.vars[BreakpointContext::Y] = y;
+  ctx.vars[BreakpointContext::P] = p;
+  ctx.vars[BreakpointContext::SP] = sp;
+  ctx.vars[BreakpointContext::PC] = pc;
+  ctx.vars[BreakpointContext::Scanline] = bus->GetPPU()->GetScanline();
+  ctx.vars[BreakpointContext::Dot] = bus->GetPPU()->GetDot();
+  ctx.vars[BreakpointContext::Addr] = addr;
+  ctx.vars[BreakpointContext::Value] = value;
+  ctx.peek = peek_bus;
+  ctx.peek_user = bus.get();
+
+  return debug_state.ConditionHolds(addr, kind, ctx);
 }
 
 void CPU::Clock()
@@ -917,7 +962,21 @@ void CPU::Clock()
     return;
   }
 
-  if (instruction_remaining_cycles == 0)
+  if (instruction_remaining_cycles == 0 && irq_sources && !GetFlag(I))
+  {
+    // Take the IRQ instead of the next instruction
+    push(pc >> 8);
+    push(pc & 0xFF);
+
+    SetFlag(B, 0);
+    SetFlag(U, 1);
+    push(p);
+    SetFlag(I, 1);
+
+    pc = read16(0xFFFE);
+    instruction_remaining_cycles = 7;
+  }
+  else if (instruction_remaining_cycles == 0)
   {
     // Read the next instruction
     opcode_pc = pc;
@@ -948,8 +1007,7 @@ int CPU::Step()
 {
   // CPU owns whether or not to actual take a step. And the PPU advances based on what the CPU does.
   // Check and see if we're about to execute on a breakpoint. If so and we're not in step mode already, drop into step mode.
-  const bool should_break = debug_state.Has(pc, Breakpoint::EXECUTE);
-  if (!in_step_mode && should_break)
+  if (!in_step_mode && debug_state.IsArmed(pc, Breakpoint::EXECUTE) && breakpoint_condition_holds(pc, Breakpoint::EXECUTE, 0))
   {
     in_step_mode = true;
     return 0;
@@ -1023,6 +1081,7 @@ void CPU::Disassemble(u16 addr_start, int count, DisassemblyEntry *disassembly_e
   // TODO : Find actual good start address which aligns with actual instructions
 
   u16 save_pc = pc;
+  watchpoints_suppressed = true;
 
   // Produce disassembly entries
   u16 addr = addr_start;
@@ -1050,66 +1109,66 @@ void CPU::Disassemble(u16 addr_start, int count, DisassemblyEntry *disassembly_e
     {
       dentry->num_instruction_bytes = 1;
       dentry->computed_operand = 0xFFFF;
-      sprintf(dentry->buffer, "%s", opcode_data.name.c_str());
+      sprintf(dentry->buffer, "%s", opcode_data.name);
     }
     else if (opcode_data.addressing == &CPU::addr_immediate)
     {
       dentry->num_instruction_bytes = 2;
-      sprintf(dentry->buffer, "%s #$%02X", opcode_data.name.c_str(), addr1);
+      sprintf(dentry->buffer, "%s #$%02X", opcode_data.name, addr1);
     }
     else if (opcode_data.addressing == &CPU::addr_absolute)
     {
       dentry->num_instruction_bytes = 3;
-      sprintf(dentry->buffer, "%s $%02X%02X", opcode_data.name.c_str(), addr2, addr1);
+      sprintf(dentry->buffer, "%s $%02X%02X", opcode_data.name, addr2, addr1);
     }
     else if (opcode_data.addressing == &CPU::addr_absolute_x)
     {
       dentry->num_instruction_bytes = 3;
-      sprintf(dentry->buffer, "%s $%02X%02X,X", opcode_data.name.c_str(), addr2, addr1);
+      sprintf(dentry->buffer, "%s $%02X%02X,X", opcode_data.name, addr2, addr1);
     }
     else if (opcode_data.addressing == &CPU::addr_absolute_y)
     {
       dentry->num_instruction_bytes = 3;
-      sprintf(dentry->buffer, "%s $%02X%02X,Y", opcode_data.name.c_str(), addr2, addr1);
+      sprintf(dentry->buffer, "%s $%02X%02X,Y", opcode_data.name, addr2, addr1);
     }
     else if (opcode_data.addressing == &CPU::addr_zeropage)
     {
       dentry->num_instruction_bytes = 2;
-      sprintf(dentry->buffer, "%s $%02X", opcode_data.name.c_str(), addr1);
+      sprintf(dentry->buffer, "%s $%02X", opcode_data.name, addr1);
     }
     else if (opcode_data.addressing == &CPU::addr_zeropage_x)
     {
       dentry->num_instruction_bytes = 2;
-      sprintf(dentry->buffer, "%s $%02X,X", opcode_data.name.c_str(), addr1);
+      sprintf(dentry->buffer, "%s $%02X,X", opcode_data.name, addr1);
     }
     else if (opcode_data.addressing == &CPU::addr_zeropage_y)
     {
       dentry->num_instruction_bytes = 2;
-      sprintf(dentry->buffer, "%s $%02X,Y", opcode_data.name.c_str(), addr1);
+      sprintf(dentry->buffer, "%s $%02X,Y", opcode_data.name, addr1);
     }
     else if (opcode_data.addressing == &CPU::addr_indirect)
     {
       dentry->num_instruction_bytes = 3;
-      sprintf(dentry->buffer, "%s ($%02X%02X)", opcode_data.name.c_str(), addr2, addr1);
+      sprintf(dentry->buffer, "%s ($%02X%02X)", opcode_data.name, addr2, addr1);
       // TODO : show indirect pointer
     }
     else if (opcode_data.addressing == &CPU::addr_indirect_x)
     {
       dentry->num_instruction_bytes = 2;
-      sprintf(dentry->buffer, "%s ($%02X,X)", opcode_data.name.c_str(), addr1);
+      sprintf(dentry->buffer, "%s ($%02X,X)", opcode_data.name, addr1);
       // TODO : show indirect pointer
     }
     else if (opcode_data.addressing == &CPU::addr_indirect_y)
     {
       dentry->num_instruction_bytes = 2;
-      sprintf(dentry->buffer, "%s ($%02X),Y", opcode_data.name.c_str(), addr1);
+      sprintf(dentry->buffer, "%s ($%02X),Y", opcode_data.name, addr1);
       // TODO : show indirect pointer
     }
     else if (opcode_data.addressing == &CPU::addr_relative)
     {
       dentry->num_instruction_bytes = 2;
       u16 branch_address = addr + addr_rel + 2;
-      sprintf(dentry->buffer, "%s $%04X", opcode_data.name.c_str(), branch_address);
+      sprintf(dentry->buffer, "%s $%04X", opcode_data.name, branch_address);
       dentry->computed_operand = branch_address;
     }
     else
@@ -1123,6 +1182,7 @@ void CPU::Disassemble(u16 addr_start, int count, DisassemblyEntry *disassembly_e
   }
 
   pc = save_pc;
+  watchpoints_suppressed = false;
 }
 
 void CPU::GetState(State *state)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <memory>
 #include <string>
 #include <vector>
@@ -15,13 +16,15 @@ class CPU
 private:
   struct InstructionEntry
   {
-    std::string name;
+    const char *name = nullptr;
     u8 (CPU::*operation)() = nullptr;
     u8 (CPU::*addressing)() = nullptr;
     u8 cycles = 0;
   };
 
-  std::vector<InstructionEntry> instructions;
+  // Shared by all instances, constant-initialized from build_instruction_table().
+  static const std::array<InstructionEntry, 256> instructions;
+  static constexpr std::array<InstructionEntry, 256> build_instruction_table();
 
 private:
   bool m_stepmode = false;
@@ -60,6 +63,7 @@ private:
   u16 oam_dma_cycles_remaining;
   u8 instruction_remaining_cycles;
   u32 total_clock_cycles = 0;
+  u8 irq_sources = 0;
 
   // Instruction Execution Pipeline
   // 1) Addressing mode function is called
@@ -174,6 +178,18 @@ public:
   bool IsPaused() const { return in_step_mode; }
 
   void TriggerNMI();
+
+  // The IRQ line is level triggered: it is taken before each instruction for as long as
+  // any of its sources (an IRQSource) holds it and the I flag is clear.
+  enum IRQSource : u8
+  {
+    IRQ_CARTRIDGE = 1 << 0,
+  };
+  void SetIRQ(IRQSource source, bool asserted)
+  {
+    irq_sources = asserted ? (irq_sources | source) : (irq_sources & ~source);
+  }
+
   void Clock();
   void Reset();
   void SoftReset(u16 pc);
@@ -201,6 +217,11 @@ private:
   CPUDebugging debug_state;
   u16 opcode_pc;
 
+  // Set while disassembling, so that peeking at code does not trip read watchpoints.
+  bool watchpoints_suppressed = false;
+
+  bool breakpoint_condition_holds(u16 addr, u8 kind, u8 value);
+
 public:
   CPUDebugging &DebuggingControls() { return debug_state; }
 };
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <algorithm>
+#include <initializer_list>
+#include <memory>
 #include <vector>
 #include "core/types.h"
+#include "core/breakpoint_condition.h"
 
 #include <unordered_map>
 #include <optional>
@@ -12,6 +15,9 @@ struct Breakpoint
   u16 addr;
   u8 mask;
 
+  // Optional condition, compiled once when the breakpoint is created. Null means always break.
+  std::shared_ptr<const BreakpointCondition> condition;
+
   static const u8 READ = 1;
   static const u8 WRITE = 2;
   static const u8 EXECUTE = 4;
@@ -19,28 +25,58 @@ struct Breakpoint
   Breakpoint() {}
   Breakpoint(u16 addr) : addr(addr), mask(EXECUTE) {}
   Breakpoint(u16 addr, u8 flags) : addr(addr), mask(flags) {}
+  Breakpoint(u16 addr, u8 flags, std::shared_ptr<const BreakpointCondition> condition)
+      : addr(addr), mask(flags), condition(condition) {}
 };
 
 class CPUDebugging
 {
 private:
-  using BreakpointMap = std::unordered_map<u16, Breakpoint>;
+  // One breakpoint per address and kind of access, each with its own condition, so e.g. a
+  // write watchpoint does not replace a read watchpoint on the same address. Keyed by
+  // key() below; each entry has a single bit in its mask.
+  using BreakpointMap = std::unordered_map<u32, Breakpoint>;
   BreakpointMap breakpoints;
 
+  // One byte of READ/WRITE/EXECUTE flags per address, so the CPU can test every fetch and
+  // access with a single load. Only allocated once the first breakpoint is added, since
+  // most consoles never have any.
+  std::unique_ptr<u8[]> armed;
+
+  static u32 key(u16 addr, u8 kind) { return ((u32)kind << 16) | addr; }
+
 public:
+  // Adds a breakpoint for each kind of access in bp.mask, replacing only those kinds
+  // already at the address.
   void Add(Breakpoint bp)
   {
-    breakpoints[bp.addr] = bp;
+    if (!armed)
+    {
+      armed.reset(new u8[0x10000]);
+      std::fill(armed.get(), armed.get() + 0x10000, 0);
+    }
+
+    for (u8 kind : {Breakpoint::READ, Breakpoint::WRITE, Breakpoint::EXECUTE})
+      if (bp.mask & kind)
+      {
+        breakpoints[key(bp.addr, kind)] = Breakpoint(bp.addr, kind, bp.condition);
+        armed[bp.addr] |= kind;
+      }
   }
 
-  void Remove(u16 addr)
+  // Removes the kinds of access in 'mask' at 'addr', leaving any others.
+  void Remove(u16 addr, u8 mask = Breakpoint::READ | Breakpoint::WRITE | Breakpoint::EXECUTE)
   {
-    breakpoints.erase(addr);
+    for (u8 kind : {Breakpoint::READ, Breakpoint::WRITE, Breakpoint::EXECUTE})
+      if (mask & kind)
+        breakpoints.erase(key(addr, kind));
+    if (armed)
+      armed[addr] &= ~mask;
   }
 
   void Remove(Breakpoint bp)
   {
-    Remove(bp.addr);
+    Remove(bp.addr, bp.mask);
   }
 
   const BreakpointMap &GetAll()
@@ -50,7 +86,23 @@ public:
 
   bool Has(u16 addr, u8 flag_filter = Breakpoint::EXECUTE)
   {
-    auto it = breakpoints.find(addr);
-    return (it != breakpoints.end()) && (it->second.mask & flag_filter);
+    return IsArmed(addr, flag_filter);
+  }
+
+  // Hot path: is anything armed at 'addr' for this kind of access?
+  bool IsArmed(u16 addr, u8 flag) const
+  {
+    return armed && (armed[addr] & flag);
+  }
+
+  // Slow path, only taken after IsArmed() hit: evaluate the condition of the breakpoint
+  // for this kind of access.
+  bool ConditionHolds(u16 addr, u8 kind, const BreakpointContext &ctx) const
+  {
+    auto it = breakpoints.find(key(addr, kind));
+    if (it == breakpoints.end())
+      return false;
+
+    return !it->second.condition || it->second.condition->Evaluate(ctx);
   }
-};
\ No newline at end of file
+};
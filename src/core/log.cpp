@@ -0,0 +1,280 @@
+#include "core/log.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+
+// A logged message, not yet formatted.
+struct LogRecord
+{
+  // Which lap of the ring this slot is ready for: equal to the write position when free,
+  // one past it once the message is in.
+  std::atomic<u64> sequence;
+
+  const char *format;
+  LogLevel level;
+  LogCategory category;
+  u8 arg_count;
+  LogArg args[Log::MAX_ARGS];
+};
+
+const int RING_SIZE = 4096; // A power of two
+const char *LEVEL_NAMES[] = {"trace", "debug", "info", "warning", "error"};
+const char *CATEGORY_NAMES[] = {"cpu", "ppu", "bus", "cartridge"};
+
+// A bounded multi-producer queue (after Dmitry Vyukov's): writers claim a slot by bumping
+// write_position, and publish it through the slot's sequence number. The single reader
+// (whoever holds reader_mutex) follows behind.
+struct LogRing
+{
+  LogRecord records[RING_SIZE];
+  std::atomic<u64> write_position;
+  std::atomic<u64> dropped;
+
+  std::mutex reader_mutex;
+  u64 read_position;
+
+  std::thread writer;
+  std::mutex writer_mutex;
+  std::condition_variable writer_wake;
+  bool writer_stopping;
+  FILE *writer_file;
+
+  LogRing() : write_position(0), dropped(0), read_position(0), writer_stopping(false), writer_file(nullptr)
+  {
+    for (int i = 0; i < RING_SIZE; ++i)
+      records[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  ~LogRing();
+};
+
+LogRing &ring()
+{
+  static LogRing instance;
+  return instance;
+}
+
+// printf() one conversion spec (without its length modifier) with an argument of whatever
+// kind was logged.
+int format_arg(char *out, size_t size, const char *spec, size_t spec_length, char conversion, const LogArg &arg)
+{
+  char fmt[32];
+  if (spec_length > sizeof(fmt) - 4)
+    spec_length = sizeof(fmt) - 4;
+  memcpy(fmt, spec, spec_length);
+  char *end = fmt + spec_length;
+
+  switch (conversion)
+  {
+  case 'd':
+  case 'i':
+  case 'u':
+  case 'o':
+  case 'x':
+  case 'X':
+  {
+    *end++ = 'l';
+    *end++ = 'l';
+    *end++ = conversion;
+    *end = 0;
+
+    long long value = arg.s;
+    if (arg.kind == LogArg::Float)
+      value = (long long)arg.f;
+    return snprintf(out, size, fmt, value);
+  }
+  case 'c':
+    *end++ = conversion;
+    *end = 0;
+    return snprintf(out, size, fmt, (int)arg.s);
+  case 'e':
+  case 'E':
+  case 'f':
+  case 'F':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+  {
+    *end++ = conversion;
+    *end = 0;
+
+    double value = arg.f;
+    if (arg.kind == LogArg::Signed)
+      value = (double)arg.s;
+    else if (arg.kind == LogArg::Unsigned)
+      value = (double)arg.u;
+    return snprintf(out, size, fmt, value);
+  }
+  case 's':
+    *end++ = conversion;
+    *end = 0;
+    return snprintf(out, size, fmt, arg.kind == LogArg::String && arg.str ? arg.str : "(?)");
+  default:
+    *end++ = 'p';
+    *end = 0;
+    return snprintf(out, size, fmt, arg.p);
+  }
+}
+
+void format_record(const LogRecord &record, char *out, size_t size)
+{
+  int length = snprintf(out, size, "[%s %s] ", LEVEL_NAMES[(int)record.level], CATEGORY_NAMES[(int)record.category]);
+  int next_arg = 0;
+
+  for (const char *c = record.format; *c && length < (int)size - 1;)
+  {
+    if (*c != '%' || c[1] == '%' || next_arg == record.arg_count)
+    {
+      out[length++] = *c;
+      c += (*c == '%' && c[1] == '%') ? 2 : 1;
+      continue;
+    }
+
+    // %[flags][width][.precision][length]conversion
+    const char *spec = c++;
+    while (*c && strchr("-+ #0123456789.", *c))
+      c++;
+    const size_t spec_length = c - spec;
+    while (*c && strchr("hlLqjzt", *c))
+      c++;
+    if (!*c)
+      break;
+
+    const int written = format_arg(out + length, size - length, spec, spec_length, *c++, record.args[next_arg++]);
+    if (written > 0)
+      length += written;
+    if (length > (int)size - 1)
+      length = (int)size - 1;
+  }
+
+  out[length] = 0;
+}
+
+void dump(LogRing &log, FILE *file)
+{
+  std::lock_guard<std::mutex> lock(log.reader_mutex);
+
+  char line[512];
+  bool wrote = false;
+  for (;;)
+  {
+    LogRecord &record = log.records[log.read_position & (RING_SIZE - 1)];
+    if (record.sequence.load(std::memory_order_acquire) != log.read_position + 1)
+      break;
+
+    format_record(record, line, sizeof(line));
+    fprintf(file, "%s\n", line);
+    wrote = true;
+
+    record.sequence.store(log.read_position + RING_SIZE, std::memory_order_release);
+    log.read_position++;
+  }
+
+  const u64 dropped = log.dropped.exchange(0, std::memory_order_relaxed);
+  if (dropped)
+    fprintf(file, "[warning log] %llu messages dropped, the log was full\n", (unsigned long long)dropped);
+
+  if (wrote || dropped)
+    fflush(file);
+}
+
+void stop_writer(LogRing &log)
+{
+  if (!log.writer.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(log.writer_mutex);
+    log.writer_stopping = true;
+  }
+  log.writer_wake.notify_one();
+  log.writer.join();
+  dump(log, log.writer_file);
+}
+
+void run_writer(LogRing &log)
+{
+  std::unique_lock<std::mutex> lock(log.writer_mutex);
+
+  while (!log.writer_stopping)
+  {
+    log.writer_wake.wait_for(lock, std::chrono::milliseconds(10));
+    FILE *file = log.writer_file;
+    lock.unlock();
+    dump(log, file);
+    lock.lock();
+  }
+}
+
+LogRing::~LogRing()
+{
+  stop_writer(*this);
+  dump(*this, stdout);
+}
+
+} // namespace
+
+void Log::Push(LogLevel level, LogCategory category, const char *format, const LogArg *args, int arg_count)
+{
+  LogRing &log = ring();
+
+  u64 position = log.write_position.load(std::memory_order_relaxed);
+  LogRecord *record;
+  for (;;)
+  {
+    record = &log.records[position & (RING_SIZE - 1)];
+    const i64 lap = (i64)(record->sequence.load(std::memory_order_acquire) - position);
+
+    if (lap == 0)
+    {
+      if (log.write_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (lap < 0)
+    {
+      // Full: the reader has not got to this slot's last message yet.
+      log.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+    {
+      position = log.write_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  record->format = format;
+  record->level = level;
+  record->category = category;
+  record->arg_count = arg_count;
+  for (int i = 0; i < arg_count; ++i)
+    record->args[i] = args[i];
+  record->sequence.store(position + 1, std::memory_order_release);
+}
+
+void Log::StartWriter(FILE *file)
+{
+  LogRing &log = ring();
+  stop_writer(log);
+
+  log.writer_file = file;
+  log.writer_stopping = false;
+  log.writer = std::thread(run_writer, std::ref(log));
+}
+
+void Log::Dump(FILE *file)
+{
+  dump(ring(), file);
+}
+
+void Log::StopWriter()
+{
+  stop_writer(ring());
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdio>
+#include <type_traits>
+#include "core/types.h"
+
+// Logging for code that runs millions of times a second.
+//
+// Messages below the compile-time minimum level of their category are compiled out
+// completely, arguments and all. Enabled ones are pushed, with their arguments in binary,
+// onto a lock-free in-memory ring; nothing is formatted until the ring is drained, either
+// by a writer thread (Log::StartWriter()) or by Log::Dump(). Whatever is left is dumped to
+// stdout at exit. If the ring fills up, new messages are dropped and counted.
+//
+//   LOG_WARNING(Bus, "Unimplemented bus write @ 0x%04X", address);
+//
+// Formats are printf-style, without length modifiers being needed: integers, floating
+// point, pointers and strings are taken as they are passed. Formats and string arguments
+// are kept by pointer, so they have to outlive the log (string literals do).
+
+enum class LogLevel : u8
+{
+  Trace,
+  Debug,
+  Info,
+  Warning,
+  Error,
+  None, // As a minimum level: nothing
+};
+
+enum class LogCategory : u8
+{
+  CPU,
+  PPU,
+  Bus,
+  Cartridge,
+  Count,
+};
+
+// Minimum level compiled in, as a LogLevel number (0 Trace ... 4 Error, 5 None), for all
+// categories and then for each one.
+#ifndef QNES_LOG_LEVEL
+#define QNES_LOG_LEVEL 2
+#endif
+#ifndef QNES_LOG_LEVEL_CPU
+#define QNES_LOG_LEVEL_CPU QNES_LOG_LEVEL
+#endif
+#ifndef QNES_LOG_LEVEL_PPU
+#define QNES_LOG_LEVEL_PPU QNES_LOG_LEVEL
+#endif
+#ifndef QNES_LOG_LEVEL_BUS
+#define QNES_LOG_LEVEL_BUS QNES_LOG_LEVEL
+#endif
+#ifndef QNES_LOG_LEVEL_CARTRIDGE
+#define QNES_LOG_LEVEL_CARTRIDGE QNES_LOG_LEVEL
+#endif
+
+constexpr int LOG_CATEGORY_LEVELS[(int)LogCategory::Count] = {
+    QNES_LOG_LEVEL_CPU,
+    QNES_LOG_LEVEL_PPU,
+    QNES_LOG_LEVEL_BUS,
+    QNES_LOG_LEVEL_CARTRIDGE,
+};
+
+constexpr bool IsLogEnabled(LogLevel level, LogCategory category)
+{
+  return level != LogLevel::None && (int)level >= LOG_CATEGORY_LEVELS[(int)category];
+}
+
+#define QNES_LOG(level, category, ...)                                     \
+  do                                                                       \
+  {                                                                        \
+    if constexpr (IsLogEnabled(LogLevel::level, LogCategory::category))   \
+      Log::Write(LogLevel::level, LogCategory::category, __VA_ARGS__);    \
+  } while (0)
+
+#define LOG_TRACE(category, ...) QNES_LOG(Trace, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) QNES_LOG(Debug, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) QNES_LOG(Info, category, __VA_ARGS__)
+#define LOG_WARNING(category, ...) QNES_LOG(Warning, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) QNES_LOG(Error, category, __VA_ARGS__)
+
+// One message argument, as it was passed.
+struct LogArg
+{
+  enum Kind : u8
+  {
+    Signed,
+    Unsigned,
+    Float,
+    Pointer,
+    String,
+  };
+
+  union
+  {
+    i64 s;
+    u64 u;
+    double f;
+    const void *p;
+    const char *str;
+  };
+  Kind kind;
+
+  LogArg() : u(0), kind(Unsigned) {}
+  LogArg(const char *value) : str(value), kind(String) {}
+
+  template <typename T>
+  LogArg(T value)
+  {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                  "Log arguments have to be numbers, pointers or strings");
+
+    if constexpr (std::is_pointer<T>::value)
+    {
+      p = value;
+      kind = Pointer;
+    }
+    else if constexpr (std::is_floating_point<T>::value)
+    {
+      f = value;
+      kind = Float;
+    }
+    else if constexpr (std::is_signed<T>::value)
+    {
+      s = (i64)value;
+      kind = Signed;
+    }
+    else
+    {
+      u = (u64)value;
+      kind = Unsigned;
+    }
+  }
+};
+
+class Log
+{
+public:
+  static const int MAX_ARGS = 8;
+
+  template <typename... Args>
+  static void Write(LogLevel level, LogCategory category, const char *format, Args... args)
+  {
+    static_assert(sizeof...(Args) <= MAX_ARGS, "Too many log arguments");
+    const LogArg packed[sizeof...(Args) + 1] = {LogArg(args)...};
+    Push(level, category, format, packed, sizeof...(Args));
+  }
+
+  // Adds a message to the ring; safe from any thread, and never blocks.
+  static void Push(LogLevel level, LogCategory category, const char *format, const LogArg *args, int arg_count);
+
+  // Formats and writes out everything logged so far.
+  static void Dump(FILE *file);
+
+  // Keep dumping to 'file' from a background thread, until StopWriter() (or exit).
+  static void StartWriter(FILE *file);
+  static void StopWriter();
+};
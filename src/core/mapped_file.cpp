@@ -0,0 +1,31 @@
+#include "core/mapped_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MapFile(const char *path, std::shared_ptr<const u8> &data, size_t &size)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat file_info;
+  if (fstat(fd, &file_info) != 0 || file_info.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  // The mapping outlives the descriptor. Private and read-only: the file is never written,
+  // and everything that maps it shares the same page cache pages.
+  const size_t mapped_size = file_info.st_size;
+  void *mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  data.reset((const u8 *)mapping, [mapped_size](const u8 *mapping) { munmap((void *)mapping, mapped_size); });
+  size = mapped_size;
+  return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include "core/types.h"
+
+// Maps all of the file at 'path' into memory, read-only. The mapping goes away with the last
+// copy of 'data'. Returns false if the file cannot be opened or mapped, or is empty.
+bool MapFile(const char *path, std::shared_ptr<const u8> &data, size_t &size);
@@ -0,0 +1,153 @@
+#include <cstring>
+#include "core/palette.h"
+
+// Palettes
+// https://wiki.nesdev.com/w/index.php/PPU_palettes
+// To get this format from a pallete file, use:
+//   hexdump -e '192/1 "0x%02x," "\n"'  PALFILE
+const u8 PALETTE_BYTES[64 * 3] = {
+    0x60, 0x60, 0x60, 0x00, 0x00, 0x78, 0x14, 0x00, 0x80, 0x2c, 0x00,
+    0x6e, 0x4a, 0x00, 0x4e, 0x6c, 0x00, 0x18, 0x5a, 0x03, 0x02, 0x51,
+    0x18, 0x00, 0x34, 0x24, 0x00, 0x00, 0x34, 0x00, 0x00, 0x32, 0x00,
+    0x00, 0x34, 0x20, 0x00, 0x2c, 0x78, 0x00, 0x00, 0x00, 0x02, 0x02,
+    0x02, 0x02, 0x02, 0x02, 0xc4, 0xc4, 0xc4, 0x00, 0x58, 0xde, 0x30,
+    0x1f, 0xfc, 0x7f, 0x14, 0xe0, 0xa8, 0x00, 0xb0, 0xc0, 0x06, 0x5c,
+    0xc0, 0x2b, 0x0e, 0xa6, 0x40, 0x10, 0x6f, 0x61, 0x00, 0x30, 0x80,
+    0x00, 0x00, 0x7c, 0x00, 0x00, 0x7c, 0x3c, 0x00, 0x6e, 0x84, 0x14,
+    0x14, 0x14, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0xf0, 0xf0, 0xf0,
+    0x4c, 0xaa, 0xff, 0x6f, 0x73, 0xf5, 0xb0, 0x70, 0xff, 0xda, 0x5a,
+    0xff, 0xf0, 0x60, 0xc0, 0xf8, 0x83, 0x6d, 0xd0, 0x90, 0x30, 0xd4,
+    0xc0, 0x30, 0x66, 0xd0, 0x00, 0x26, 0xdd, 0x1a, 0x2e, 0xc8, 0x66,
+    0x34, 0xc2, 0xbe, 0x54, 0x54, 0x54, 0x06, 0x06, 0x06, 0x06, 0x06,
+    0x06, 0xff, 0xff, 0xff, 0xb6, 0xda, 0xff, 0xc8, 0xca, 0xff, 0xda,
+    0xc2, 0xff, 0xf0, 0xbe, 0xff, 0xfc, 0xbc, 0xee, 0xff, 0xd0, 0xb4,
+    0xff, 0xda, 0x90, 0xec, 0xec, 0x92, 0xdc, 0xf6, 0x9e, 0xb8, 0xff,
+    0xa2, 0xae, 0xea, 0xbe, 0x9e, 0xef, 0xef, 0xbe, 0xbe, 0xbe, 0x08,
+    0x08, 0x08, 0x08, 0x08, 0x08};
+
+// Each emphasis bit darkens the two color channels it does not name. This is the usual
+// RGB approximation of what emphasis does to the composite signal.
+// https://wiki.nesdev.com/w/index.php/NTSC_video
+static const float EMPHASIS_ATTENUATION = 0.816328f;
+
+struct IndexedPalette
+{
+  u8 rgb[INDEXED_COLOR_COUNT * 3];
+  u8 rgba[INDEXED_COLOR_COUNT * 4];
+
+  // The same colors as whole pixels in the other output formats
+  u32 bgra32[INDEXED_COLOR_COUNT];
+  u16 rgb565[INDEXED_COLOR_COUNT];
+
+  IndexedPalette()
+  {
+    for (int i = 0; i < INDEXED_COLOR_COUNT; ++i)
+    {
+      const int color = i & 0x3F;
+      const int emphasis = i >> 6;
+
+      for (int channel = 0; channel < 3; ++channel)
+      {
+        float value = PALETTE_BYTES[3 * color + channel];
+        for (int bit = 0; bit < 3; ++bit)
+          if ((emphasis & (1 << bit)) && bit != channel)
+            value *= EMPHASIS_ATTENUATION;
+
+        const u8 byte = (u8)(value + 0.5f);
+        rgb[3 * i + channel] = byte;
+        rgba[4 * i + channel] = byte;
+      }
+      rgba[4 * i + 3] = 0xFF;
+
+      const u8 *c = &rgba[4 * i];
+      const u8 bgra[4] = {c[2], c[1], c[0], 0xFF};
+      memcpy(&bgra32[i], bgra, 4);
+      rgb565[i] = ((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3);
+    }
+  }
+};
+
+static const IndexedPalette &indexed_palette()
+{
+  static const IndexedPalette palette;
+  return palette;
+}
+
+const u8 *GetIndexedPaletteRGB()
+{
+  return indexed_palette().rgb;
+}
+
+const u8 *GetIndexedPaletteRGBA()
+{
+  return indexed_palette().rgba;
+}
+
+void ConvertIndexedToRGB(const u16 *indexed, u8 *rgb, int count)
+{
+  if (count <= 0)
+    return;
+
+  // Copy 4 bytes (RGBA) per pixel; the stray alpha byte is overwritten by the next pixel.
+  // The last pixel is copied on its own so nothing is written past the end.
+  const u8 *lut = indexed_palette().rgba;
+  for (int i = 0; i < count - 1; ++i)
+    memcpy(&rgb[3 * i], &lut[4 * (indexed[i] & 0x1FF)], 4);
+
+  memcpy(&rgb[3 * (count - 1)], &lut[4 * (indexed[count - 1] & 0x1FF)], 3);
+}
+
+void ConvertIndexedToRGBA(const u16 *indexed, u8 *rgba, int count)
+{
+  const u8 *lut = indexed_palette().rgba;
+  for (int i = 0; i < count; ++i)
+    memcpy(&rgba[4 * i], &lut[4 * (indexed[i] & 0x1FF)], 4);
+}
+
+int GetPixelFormatBytes(PixelFormat format)
+{
+  switch (format)
+  {
+  case PixelFormat::RGBA8888:
+  case PixelFormat::BGRA8888:
+    return 4;
+  case PixelFormat::RGB565:
+    return 2;
+  case PixelFormat::Indexed8:
+    return 1;
+  }
+  return 0;
+}
+
+void ConvertIndexedPixels(const u16 *indexed, void *out, int count, PixelFormat format)
+{
+  const IndexedPalette &palette = indexed_palette();
+
+  switch (format)
+  {
+  case PixelFormat::RGBA8888:
+    ConvertIndexedToRGBA(indexed, (u8 *)out, count);
+    break;
+  case PixelFormat::BGRA8888:
+  {
+    u8 *bgra = (u8 *)out;
+    for (int i = 0; i < count; ++i)
+      memcpy(&bgra[4 * i], &palette.bgra32[indexed[i] & 0x1FF], 4);
+    break;
+  }
+  case PixelFormat::RGB565:
+  {
+    u8 *rgb565 = (u8 *)out;
+    for (int i = 0; i < count; ++i)
+      memcpy(&rgb565[2 * i], &palette.rgb565[indexed[i] & 0x1FF], 2);
+    break;
+  }
+  case PixelFormat::Indexed8:
+  {
+    u8 *colors = (u8 *)out;
+    for (int i = 0; i < count; ++i)
+      colors[i] = indexed[i] & 0x3F;
+    break;
+  }
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "core/types.h"
+
+// The 64 NES colors as RGB.
+extern const u8 PALETTE_BYTES[64 * 3];
+
+// The PPU's output format: one u16 per pixel, with the NES color (0-63, greyscale already
+// applied) in bits 0-5 and the PPUMASK emphasis bits (red, green, blue) in bits 6-8.
+static const int INDEXED_COLOR_COUNT = 512;
+
+inline u16 MakeIndexedColor(u8 color, u8 emphasis)
+{
+  return (color & 0x3F) | ((emphasis & 7) << 6);
+}
+
+// RGB and RGBA (alpha 255) for every indexed color, with emphasis applied.
+const u8 *GetIndexedPaletteRGB();
+const u8 *GetIndexedPaletteRGBA();
+
+// Convert 'count' indexed pixels.
+void ConvertIndexedToRGB(const u16 *indexed, u8 *rgb, int count);
+void ConvertIndexedToRGBA(const u16 *indexed, u8 *rgba, int count);
+
+// Formats the finished picture can be delivered in (see PPU::SetFrameOutput()).
+//  - RGBA8888, BGRA8888: 4 bytes per pixel in that order in memory, alpha 255.
+//  - RGB565: one native-endian u16 per pixel, red in the top 5 bits.
+//  - Indexed8: the NES color (0-63), without emphasis.
+enum class PixelFormat
+{
+  RGBA8888,
+  BGRA8888,
+  RGB565,
+  Indexed8,
+};
+
+int GetPixelFormatBytes(PixelFormat format);
+
+// Convert 'count' indexed pixels to 'format'.
+void ConvertIndexedPixels(const u16 *indexed, void *out, int count, PixelFormat format);
@@ -0,0 +1,255 @@
+#include <cstring>
+#include "core/pixel_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define QNES_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+SIMDLevel DetectSIMDLevel()
+{
+#if QNES_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SIMDLevel::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SIMDLevel::SSE2;
+#endif
+  return SIMDLevel::Scalar;
+}
+
+const char *SIMDLevelName(SIMDLevel level)
+{
+  switch (level)
+  {
+  case SIMDLevel::AVX2:
+    return "AVX2";
+  case SIMDLevel::SSE2:
+    return "SSE2";
+  default:
+    return "Scalar";
+  }
+}
+
+MixLineFn GetMixLineKernel(SIMDLevel level)
+{
+#if QNES_X86_KERNELS
+  if (level == SIMDLevel::AVX2)
+    return MixLineAVX2;
+  if (level == SIMDLevel::SSE2)
+    return MixLineSSE2;
+#endif
+  return MixLineScalar;
+}
+
+HashLineFn GetHashLineKernel(SIMDLevel level)
+{
+#if QNES_X86_KERNELS
+  if (level == SIMDLevel::AVX2)
+    return HashLineAVX2;
+  if (level == SIMDLevel::SSE2)
+    return HashLineSSE2;
+#endif
+  return HashLineScalar;
+}
+
+////////////////////////////////////////////////////
+// Scalar reference
+
+// Background wins where the sprite is transparent, or where both are opaque and the sprite
+// is flagged as behind the background. The result indexes the 32 entry palette.
+void MixLineScalar(const u8 *bg, const u8 *sprite, const LinePalette &palette, u16 *out)
+{
+  for (int x = 0; x < 256; ++x)
+    out[x] = palette.colors[MixLinePixel(bg[x], sprite[x])] | palette.emphasis;
+}
+
+////////////////////////////////////////////////////
+// Line hash: shared parts. A line is 512 bytes, 8 stripes of 64. Stripe s, lane i mixes
+// in key s + i; the final fold uses keys 8-15.
+
+static const int HASH_LINE_BYTES = 256 * 2;
+static const int HASH_STRIPES = HASH_LINE_BYTES / 64;
+
+alignas(32) static const u64 HASH_KEYS[16] = {
+    0xc584133ac916ab3cull, 0x3ee5789041c98ac3ull, 0xf3b8488c368cb0a6ull, 0x657eecdd3cb13d09ull,
+    0xc2d326e0055bdef6ull, 0x8621a03fe0bbdb7bull, 0x8e1f7555983aa92full, 0xb54e0f1600cc4d19ull,
+    0x84bb3f97971d80abull, 0x7d29825c75521255ull, 0xc3cf17102b7f7f86ull, 0x3466e9a083914f64ull,
+    0xd81a8d2b5a4485acull, 0xdb01602b100b9ed7ull, 0xa9038a921825f10dull, 0xedf5f1d90dca2f6aull};
+
+alignas(32) static const u64 HASH_INITIAL_LANES[8] = {
+    0x00000000C2B2AE3Dull, 0x9E3779B185EBCA87ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+    0x85EBCA77C2B2AE63ull, 0x0000000085EBCA77ull, 0x27D4EB2F165667C5ull, 0x000000009E3779B1ull};
+
+static u64 fold_hash_lanes(const u64 *lanes)
+{
+  u64 hash = HASH_LINE_BYTES * 0x9E3779B185EBCA87ull;
+  for (int i = 0; i < 8; i += 2)
+  {
+    const unsigned __int128 product = (unsigned __int128)(lanes[i] ^ HASH_KEYS[8 + i]) * (lanes[i + 1] ^ HASH_KEYS[9 + i]);
+    hash += (u64)product ^ (u64)(product >> 64);
+  }
+
+  hash ^= hash >> 37;
+  hash *= 0x165667919E3779F9ull;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+u64 HashLineScalar(const u16 *pixels)
+{
+  u64 lanes[8];
+  memcpy(lanes, HASH_INITIAL_LANES, sizeof(lanes));
+
+  const u8 *bytes = (const u8 *)pixels;
+  for (int stripe = 0; stripe < HASH_STRIPES; ++stripe)
+  {
+    for (int i = 0; i < 8; ++i)
+    {
+      u64 data;
+      memcpy(&data, &bytes[64 * stripe + 8 * i], 8);
+      const u64 keyed = data ^ HASH_KEYS[stripe + i];
+      lanes[i ^ 1] += data;
+      lanes[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+    }
+  }
+  return fold_hash_lanes(lanes);
+}
+
+#if QNES_X86_KERNELS
+
+////////////////////////////////////////////////////
+// Line hash, SSE2: two lanes per register. Swapping the 64-bit halves of the data lines
+// each value up with the neighbouring lane it is added to.
+
+__attribute__((target("sse2"))) u64 HashLineSSE2(const u16 *pixels)
+{
+  __m128i lanes[4];
+  for (int i = 0; i < 4; ++i)
+    lanes[i] = _mm_load_si128((const __m128i *)&HASH_INITIAL_LANES[2 * i]);
+
+  const u8 *bytes = (const u8 *)pixels;
+  for (int stripe = 0; stripe < HASH_STRIPES; ++stripe)
+  {
+    for (int i = 0; i < 4; ++i)
+    {
+      const __m128i data = _mm_loadu_si128((const __m128i *)&bytes[64 * stripe + 16 * i]);
+      const __m128i key = _mm_loadu_si128((const __m128i *)&HASH_KEYS[stripe + 2 * i]);
+      const __m128i keyed = _mm_xor_si128(data, key);
+      const __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+      const __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      lanes[i] = _mm_add_epi64(lanes[i], _mm_add_epi64(product, swapped));
+    }
+  }
+
+  alignas(16) u64 folded[8];
+  for (int i = 0; i < 4; ++i)
+    _mm_store_si128((__m128i *)&folded[2 * i], lanes[i]);
+  return fold_hash_lanes(folded);
+}
+
+////////////////////////////////////////////////////
+// Line hash, AVX2: as SSE2, four lanes per register.
+
+__attribute__((target("avx2"))) u64 HashLineAVX2(const u16 *pixels)
+{
+  __m256i lanes[2];
+  for (int i = 0; i < 2; ++i)
+    lanes[i] = _mm256_load_si256((const __m256i *)&HASH_INITIAL_LANES[4 * i]);
+
+  const u8 *bytes = (const u8 *)pixels;
+  for (int stripe = 0; stripe < HASH_STRIPES; ++stripe)
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      const __m256i data = _mm256_loadu_si256((const __m256i *)&bytes[64 * stripe + 32 * i]);
+      const __m256i key = _mm256_loadu_si256((const __m256i *)&HASH_KEYS[stripe + 4 * i]);
+      const __m256i keyed = _mm256_xor_si256(data, key);
+      const __m256i product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+      const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      lanes[i] = _mm256_add_epi64(lanes[i], _mm256_add_epi64(product, swapped));
+    }
+  }
+
+  alignas(32) u64 folded[8];
+  for (int i = 0; i < 2; ++i)
+    _mm256_store_si256((__m256i *)&folded[4 * i], lanes[i]);
+  return fold_hash_lanes(folded);
+}
+
+////////////////////////////////////////////////////
+// SSE2: select palette entries 16 pixels at a time. SSE2 has no byte shuffle to do the
+// palette lookup with, so that part stays scalar, but without the per-pixel branches.
+
+__attribute__((target("sse2"))) void MixLineSSE2(const u8 *bg, const u8 *sprite, const LinePalette &palette, u16 *out)
+{
+  alignas(16) u8 selection[256];
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i color_mask = _mm_set1_epi8(3);
+  const __m128i behind_mask = _mm_set1_epi8(LINE_MIX_SPRITE_BEHIND_BG);
+  const __m128i palette_mask = _mm_set1_epi8(0x1F);
+
+  for (int x = 0; x < 256; x += 16)
+  {
+    const __m128i b = _mm_loadu_si128((const __m128i *)&bg[x]);
+    const __m128i s = _mm_loadu_si128((const __m128i *)&sprite[x]);
+
+    const __m128i sprite_transparent = _mm_cmpeq_epi8(_mm_and_si128(s, color_mask), zero);
+    const __m128i bg_transparent = _mm_cmpeq_epi8(_mm_and_si128(b, color_mask), zero);
+    const __m128i behind = _mm_cmpeq_epi8(_mm_and_si128(s, behind_mask), behind_mask);
+
+    const __m128i bg_wins = _mm_or_si128(sprite_transparent, _mm_andnot_si128(bg_transparent, behind));
+    const __m128i selected = _mm_or_si128(_mm_and_si128(bg_wins, b),
+                                          _mm_andnot_si128(bg_wins, _mm_and_si128(s, palette_mask)));
+
+    _mm_store_si128((__m128i *)&selection[x], selected);
+  }
+
+  for (int x = 0; x < 256; ++x)
+    out[x] = palette.colors[selection[x]] | palette.emphasis;
+}
+
+////////////////////////////////////////////////////
+// AVX2: select 32 pixels at a time and look the palette up with byte shuffles (two 16 entry
+// halves, chosen by bit 4), then widen to 16 bits and add the emphasis bits.
+
+__attribute__((target("avx2"))) void MixLineAVX2(const u8 *bg, const u8 *sprite, const LinePalette &palette, u16 *out)
+{
+  // Lookup tables for palette entries 0-15 and 16-31, in both 128 bit lanes.
+  const __m256i colors_lower = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)&palette.colors[0]));
+  const __m256i colors_upper = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)&palette.colors[16]));
+  const __m256i emphasis = _mm256_set1_epi16(palette.emphasis);
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i color_mask = _mm256_set1_epi8(3);
+  const __m256i behind_mask = _mm256_set1_epi8(LINE_MIX_SPRITE_BEHIND_BG);
+  const __m256i palette_mask = _mm256_set1_epi8(0x1F);
+
+  for (int x = 0; x < 256; x += 32)
+  {
+    const __m256i b = _mm256_loadu_si256((const __m256i *)&bg[x]);
+    const __m256i s = _mm256_loadu_si256((const __m256i *)&sprite[x]);
+
+    const __m256i sprite_transparent = _mm256_cmpeq_epi8(_mm256_and_si256(s, color_mask), zero);
+    const __m256i bg_transparent = _mm256_cmpeq_epi8(_mm256_and_si256(b, color_mask), zero);
+    const __m256i behind = _mm256_cmpeq_epi8(_mm256_and_si256(s, behind_mask), behind_mask);
+
+    const __m256i bg_wins = _mm256_or_si256(sprite_transparent, _mm256_andnot_si256(bg_transparent, behind));
+    const __m256i selected = _mm256_blendv_epi8(_mm256_and_si256(s, palette_mask), b, bg_wins);
+
+    // Entries 16-31 have bit 4 set; move it to bit 7 for the blend. The 16 bit shift only
+    // pulls neighbouring bits into the low bits of each byte, which the blend ignores.
+    const __m256i upper_half = _mm256_slli_epi16(selected, 3);
+    const __m256i colors = _mm256_blendv_epi8(_mm256_shuffle_epi8(colors_lower, selected),
+                                              _mm256_shuffle_epi8(colors_upper, selected),
+                                              upper_half);
+
+    const __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(colors));
+    const __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(colors, 1));
+    _mm256_storeu_si256((__m256i *)&out[x], _mm256_or_si256(lo, emphasis));
+    _mm256_storeu_si256((__m256i *)&out[x + 16], _mm256_or_si256(hi, emphasis));
+  }
+}
+
+#endif
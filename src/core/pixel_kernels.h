@@ -0,0 +1,69 @@
+#pragma once
+
+#include "core/types.h"
+
+// Data-parallel pixel work for the PPU, with a scalar reference implementation and SIMD
+// versions picked at runtime. Every kernel produces bit-identical output to its scalar
+// reference.
+
+enum class SIMDLevel
+{
+  Scalar,
+  SSE2,
+  AVX2,
+};
+
+// Best level supported by the CPU we are running on.
+SIMDLevel DetectSIMDLevel();
+const char *SIMDLevelName(SIMDLevel level);
+
+// A scanline's 32 palette entries ($3F00-$3F1F), greyscale already applied, and the
+// emphasis bits to put in every pixel (see core/palette.h for the output format).
+struct LinePalette
+{
+  alignas(32) u8 colors[32];
+  u16 emphasis;
+};
+
+// Sprite line pixels with this bit set are drawn behind opaque background pixels.
+static const u8 LINE_MIX_SPRITE_BEHIND_BG = 0x20;
+
+// Compose one 256 pixel scanline into indexed colors.
+//
+//   bg:          (palette << 2) | color for $3F00-$3F0F, 0 where the background is hidden
+//   sprite:      0 where transparent, else 0x10 | (palette << 2) | color, optionally with
+//                LINE_MIX_SPRITE_BEHIND_BG. Other high bits are ignored.
+//   palette:     the line's palette
+//   out:         256 indexed pixels
+using MixLineFn = void (*)(const u8 *bg, const u8 *sprite, const LinePalette &palette, u16 *out);
+
+// The palette index (0-31) one pixel of the above mixes to.
+inline u8 MixLinePixel(u8 bg, u8 sprite)
+{
+  const bool sprite_opaque = (sprite & 3) != 0;
+  const bool bg_opaque = (bg & 3) != 0;
+  const bool behind = (sprite & LINE_MIX_SPRITE_BEHIND_BG) != 0;
+
+  if (sprite_opaque && (!bg_opaque || !behind))
+    return sprite & 0x1F;
+  return bg;
+}
+
+void MixLineScalar(const u8 *bg, const u8 *sprite, const LinePalette &palette, u16 *out);
+void MixLineSSE2(const u8 *bg, const u8 *sprite, const LinePalette &palette, u16 *out);
+void MixLineAVX2(const u8 *bg, const u8 *sprite, const LinePalette &palette, u16 *out);
+
+// Kernel for 'level', falling back to the next best one if it is not compiled in.
+MixLineFn GetMixLineKernel(SIMDLevel level);
+
+// 64-bit hash of one 256 pixel line of indexed colors (core/palette.h), in the style of
+// XXH3: eight 64-bit lanes take 64 bytes at a time with 32x32->64 bit multiplies, which
+// vectorize, and are folded together at the end. For spotting changed content, not for
+// security.
+using HashLineFn = u64 (*)(const u16 *pixels);
+
+u64 HashLineScalar(const u16 *pixels);
+u64 HashLineSSE2(const u16 *pixels);
+u64 HashLineAVX2(const u16 *pixels);
+
+HashLineFn GetHashLineKernel(SIMDLevel level);
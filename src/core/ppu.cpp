@@ -1,37 +1,30 @@
 #include "./ppu.h"
 #include "core/bus.h"
 #include "core/cartridge.h"
+#include "core/log.h"
+#include "core/palette.h"
+#include "core/ppu_timing.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
-// Palettes
-// https://wiki.nesdev.com/w/index.php/PPU_palettes
-// To get this format from a pallete file, use:
-//   hexdump -e '192/1 "0x%02x," "\n"'  PALFILE
-u8 PALETTE_BYTES[64 * 3] = {
-    0x60, 0x60, 0x60, 0x00, 0x00, 0x78, 0x14, 0x00, 0x80, 0x2c, 0x00,
-    0x6e, 0x4a, 0x00, 0x4e, 0x6c, 0x00, 0x18, 0x5a, 0x03, 0x02, 0x51,
-    0x18, 0x00, 0x34, 0x24, 0x00, 0x00, 0x34, 0x00, 0x00, 0x32, 0x00,
-    0x00, 0x34, 0x20, 0x00, 0x2c, 0x78, 0x00, 0x00, 0x00, 0x02, 0x02,
-    0x02, 0x02, 0x02, 0x02, 0xc4, 0xc4, 0xc4, 0x00, 0x58, 0xde, 0x30,
-    0x1f, 0xfc, 0x7f, 0x14, 0xe0, 0xa8, 0x00, 0xb0, 0xc0, 0x06, 0x5c,
-    0xc0, 0x2b, 0x0e, 0xa6, 0x40, 0x10, 0x6f, 0x61, 0x00, 0x30, 0x80,
-    0x00, 0x00, 0x7c, 0x00, 0x00, 0x7c, 0x3c, 0x00, 0x6e, 0x84, 0x14,
-    0x14, 0x14, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0xf0, 0xf0, 0xf0,
-    0x4c, 0xaa, 0xff, 0x6f, 0x73, 0xf5, 0xb0, 0x70, 0xff, 0xda, 0x5a,
-    0xff, 0xf0, 0x60, 0xc0, 0xf8, 0x83, 0x6d, 0xd0, 0x90, 0x30, 0xd4,
-    0xc0, 0x30, 0x66, 0xd0, 0x00, 0x26, 0xdd, 0x1a, 0x2e, 0xc8, 0x66,
-    0x34, 0xc2, 0xbe, 0x54, 0x54, 0x54, 0x06, 0x06, 0x06, 0x06, 0x06,
-    0x06, 0xff, 0xff, 0xff, 0xb6, 0xda, 0xff, 0xc8, 0xca, 0xff, 0xda,
-    0xc2, 0xff, 0xf0, 0xbe, 0xff, 0xfc, 0xbc, 0xee, 0xff, 0xd0, 0xb4,
-    0xff, 0xda, 0x90, 0xec, 0xec, 0x92, 0xdc, 0xf6, 0x9e, 0xb8, 0xff,
-    0xa2, 0xae, 0xea, 0xbe, 0x9e, 0xef, 0xef, 0xbe, 0xbe, 0xbe, 0x08,
-    0x08, 0x08, 0x08, 0x08, 0x08};
-
 // NES Framebuffer/Screen size
 const int WIDTH = 256;
 const int HEIGHT = 240;
 
+// The picture before anything is drawn, shared by every PPU. Never written, but not const,
+// so that it is zero pages rather than 120KB of the binary.
+static u16 BLANK_FRAME[WIDTH * HEIGHT];
+
+// The frame hash: each line's hash mixed in, in order, starting from the seed.
+static const u64 FRAME_HASH_SEED = 0x27D4EB2F165667C5ull;
+
+static u64 mix_frame_hash(u64 frame_hash, u64 line_hash)
+{
+  const u64 mixed = frame_hash ^ line_hash;
+  return ((mixed << 31) | (mixed >> 33)) * 0x9E3779B185EBCA87ull;
+}
+
 PPU::PPU()
 {
   pixel_y = 0;
@@ -45,6 +38,8 @@ PPU::PPU()
   scroll_x = 0;
   scroll_y = 0;
   vram_addr = 0;
+  temp_vram_addr = 0;
+  fine_x_scroll = 0;
 
   address_latch = 0;
   vram = new u8[0x4000];
@@ -52,18 +47,105 @@ PPU::PPU()
   memset(vram, 0, 0x4000);
   memset(OAM_RAM, 0, 64 * 4);
 
-  frame_buffer.Resize(WIDTH, HEIGHT);
+  // The PPU renders indexed colors, into a frame allocated once it draws something (see
+  // allocate_frame()). The RGB copy of the frame is only allocated and filled in for
+  // callers of GetFrameBufferTexture().
+  rgb_frame_stale = true;
+  frame_output = nullptr;
+  frame_output_pitch = 0;
+  frame_output_format = PixelFormat::RGBA8888;
+
+  // The pattern table and nametable textures are only needed by the debugger, so they are
+  // allocated the first time someone asks for them (see allocate_debug_textures()).
+  debug_textures_allocated = false;
+  sprite_zero_hit_x = -1;
+  secondary_oam_count = 0;
+
+  scanline_counter = false;
+  scanline_counter_synced = 0;
+  scanline_irq_position = NO_SCANLINE_IRQ;
+
+  mix_line = GetMixLineKernel(DetectSIMDLevel());
+  line_palette_dirty = true;
+  chr_slots_cart = nullptr;
+  chr_slots_serial = 0;
+  sprite_zero_in_secondary_oam = false;
+
+  mark_background_dirty();
+  background_tiles_written = false;
+  memset(background_written_tiles, 0, sizeof(background_written_tiles));
+  background_table = false;
+  memset(background_slots, 0, sizeof(background_slots));
+  memset(background_pages, 0, sizeof(background_pages));
+
+  render_mode = PPURenderMode::Synchronous;
+  logged_mirroring = MirroringMode::Horizontal;
+  replaying = false;
+  nametable_pages = nullptr;
+  skip_frame_output = skipping_frame_output = false;
+
+  backend = PPUBackend::Fast;
+  loopy_frame = false;
+  auto_accurate_frames = 0;
+  odd_frame = false;
+  next_tile_id = next_tile_attribute = next_tile_lsb = next_tile_msb = 0;
+  pattern_shift_lo = pattern_shift_hi = 0;
+  attribute_shift_lo = attribute_shift_hi = 0;
+
+  // Every PPU starts out with the same blank lines, so their hashes are worked out once.
+  hash_line = GetHashLineKernel(DetectSIMDLevel());
+  static const u64 blank_line_hash = hash_line(BLANK_FRAME);
+  static const u64 blank_frame_hash = []() {
+    u64 hash = FRAME_HASH_SEED;
+    for (int line = 0; line < HEIGHT; ++line)
+      hash = mix_frame_hash(hash, blank_line_hash);
+    return hash;
+  }();
+  std::fill_n(line_hashes, HEIGHT, blank_line_hash);
+  std::fill_n(frame_line_hashes, HEIGHT, blank_line_hash);
+  memset(dirty_lines, 0, sizeof(dirty_lines));
+  dirty_line_count = 0;
+  frame_hash = blank_frame_hash;
+}
+
+PPU::~PPU()
+{
+  delete[] vram;
+  delete[] OAM_RAM;
+}
+
+void PPU::SetCartridge(std::shared_ptr<Cartridge> &cart)
+{
+  // A shadow PPU drawing the old cartridge's frame is no use; it is restarted at the end
+  // of the frame.
+  replay.reset();
+
+  this->cart = cart;
+  cart->AttachNametableRAM(vram + 0x2000);
+  nametable_pages = cart->GetNametablePages();
+  mark_background_dirty();
+
+  // A new counter starts counting from here.
+  scanline_counter = cart->HasScanlineCounter();
+  scanline_counter_synced = frame_position();
+  scanline_irq_position = NO_SCANLINE_IRQ;
+  bus->SetCartridgeIRQ(false);
+  ScheduleScanlineIRQ();
+}
+
+void PPU::allocate_debug_textures()
+{
   pattern_left.Resize(128, 128);
   pattern_right.Resize(128, 128);
 
   // This would ideally by 2*(256,240), but to simplify life for
   // OpenGL, making this a power-of-two texture
   nametables.Resize(256 * 2, 256 * 2);
-}
+  debug_textures_allocated = true;
 
-PPU::~PPU()
-{
-  delete[] vram;
+  // Nothing has been drawn yet
+  pattern_view_changes.Reset();
+  nametable_view_changes.Reset();
 }
 
 void PPU::GetState(PPURegisterState *state)
@@ -73,6 +155,8 @@ void PPU::GetState(PPURegisterState *state)
 
   state->OAMADDR = OAMADDR;
   state->vram_addr = vram_addr;
+  state->temp_vram_addr = temp_vram_addr;
+  state->fine_x_scroll = fine_x_scroll;
 
   state->PPUSTATUS = PPUSTATUS;
   state->PPUCTRL = PPUCTRL;
@@ -110,22 +194,31 @@ u8 PPU::Read(u16 addr)
     PPU_DATA_read_buffer = ppuRead(vram_addr & 0x3FFF);
 
     // However, if the read is to a pallete, the data is returned immediately.
-    if (vram_addr >= 0x3F00)
+    if ((vram_addr & 0x3FFF) >= 0x3F00)
       return_value = PPU_DATA_read_buffer;
 
-    // Auto-increment the internal VRAM pointer by an amount
-    // specified in PPUCTRL
-    u8 addr_increment = (PPUCTRL & 0b100) ? 32 : 1;
-    vram_addr = (vram_addr + addr_increment) & 0x3FFF;
+    increment_vram_addr();
     return return_value;
   }
   else
   {
-    printf("Unimplemmented PPU read @ 0x%04X\n", addr);
+    LOG_WARNING(PPU, "Unimplemented PPU read @ 0x%04X", addr);
     return 0;
   }
 }
 
+u8 PPU::Peek(u16 addr) const
+{
+  if (addr == 0x2000)
+    return PPUCTRL;
+  else if (addr == 0x2002)
+    return PPUSTATUS;
+  else if (addr == 0x2007)
+    return PPU_DATA_read_buffer;
+  else
+    return 0;
+}
+
 void PPU::Write(u16 addr, u8 val)
 {
   if (addr == 0x2000)
@@ -139,11 +232,29 @@ void PPU::Write(u16 addr, u8 val)
       bus->TriggerNMI();
     }
 
+    // Nametable select moves the scroll like a $2005 write does.
+    if ((PPUCTRL ^ val) & 3)
+      note_mid_frame_scroll();
+    temp_vram_addr = (temp_vram_addr & 0xF3FF) | ((val & 3) << 10);
+
+    // The pattern tables decide when the scanline counter is clocked.
+    SyncScanlineCounter();
     PPUCTRL = val;
+    ScheduleScanlineIRQ();
+    if (replay)
+      log_event(PPULogEvent::Ctrl, addr, val);
   }
   else if (addr == 0x2001)
   {
+    if ((PPUMASK ^ val) & 1)
+      line_palette_dirty = true; // Greyscale changed
+
+    // As does whether rendering is on at all.
+    SyncScanlineCounter();
     PPUMASK = val;
+    ScheduleScanlineIRQ();
+    if (replay)
+      log_event(PPULogEvent::Mask, addr, val);
   }
   else if (addr == 0x2003)
   {
@@ -151,33 +262,50 @@ void PPU::Write(u16 addr, u8 val)
   }
   else if (addr == 0x2004)
   {
+    if (replay)
+      log_event(PPULogEvent::OAMWrite, OAMADDR, val);
     OAM_RAM[OAMADDR] = val;
     OAMADDR = (OAMADDR + 1) & 0xFF;
   }
   else if (addr == 0x2005)
   {
+    if (replay)
+      log_event(address_latch ? PPULogEvent::ScrollY : PPULogEvent::ScrollX, addr, val);
+
+    note_mid_frame_scroll();
+
     if (address_latch == 0)
     {
       scroll_x = val;
+      temp_vram_addr = (temp_vram_addr & 0xFFE0) | (val >> 3);
+      fine_x_scroll = val & 7;
       address_latch = 1;
     }
     else
     {
       scroll_y = val;
+      temp_vram_addr = (temp_vram_addr & 0x8C1F) | ((val & 7) << 12) | ((val >> 3) << 5);
       address_latch = 0;
       // printf("[SL %d] Changed Scroll to (%d,%d)\n", pixel_y, scroll_x, scroll_y); // SMB1 debugging...
     }
   }
   else if (addr == 0x2006) // PPUADDR
   {
+    if (replay)
+      log_event(PPULogEvent::Address, address_latch, val);
+
+    note_mid_frame_scroll();
+
+    // The first write only goes to t; v takes all of it on the second.
     if (address_latch == 0)
     {
-      vram_addr = (val & 0x7F) << 8;
+      temp_vram_addr = (temp_vram_addr & 0x00FF) | ((val & 0x3F) << 8);
       address_latch = 1;
     }
     else
     {
-      vram_addr = vram_addr | val;
+      temp_vram_addr = (temp_vram_addr & 0xFF00) | val;
+      vram_addr = temp_vram_addr;
       address_latch = 0;
     }
   }
@@ -186,7 +314,7 @@ void PPU::Write(u16 addr, u8 val)
     // Write the value currently pointed at by the internal address latch,
     // then increment based on bit 2 of PPUCTRL
 
-    vram_addr &= 0x3FFF;
+    const u16 data_addr = vram_addr & 0x3FFF;
 
     /*
     // TODO
@@ -200,9 +328,27 @@ void PPU::Write(u16 addr, u8 val)
     if (vram_addr == 0x3F1C) vram_addr = 0x3F0C;
     */
 
-    vram[NametableMirroring(vram_addr)] = val;
-    u8 addr_increment = (PPUCTRL & 0b100) ? 32 : 1;
-    vram_addr = (vram_addr + addr_increment) & 0x3FFF;
+    const u16 mirrored_addr = NametableMirroring(data_addr);
+    if (mirrored_addr < 0x2000 && cart->PPUWrite(mirrored_addr, val))
+    {
+      // CHR-RAM: the cartridge marks the tile dirty (see take_chr_writes()). The shadow
+      // has its own copy, which it updates by offset, as the mapping may have changed by
+      // the time it gets there.
+      u32 offset;
+      if (replay && cart->MapCHR(mirrored_addr, offset))
+        log_event(PPULogEvent::CHRWrite, mirrored_addr, val, offset);
+    }
+    else
+    {
+      write_vram(mirrored_addr, val);
+      if (replay)
+        log_event(PPULogEvent::VRAMWrite, mirrored_addr, val);
+    }
+
+    if (debug_textures_allocated)
+      note_debug_view_write(data_addr);
+
+    increment_vram_addr();
   }
   else if (addr == 0x4014)
   {
@@ -215,140 +361,465 @@ void PPU::Write(u16 addr, u8 val)
       OAM_RAM[i & 0xFF] = bus->Read(page | ((OAMADDR)&0xFF));
       OAMADDR++;
     }
+
+    if (replay)
+      for (int i = 0; i < 256; ++i)
+        log_event(PPULogEvent::OAMWrite, i, OAM_RAM[i]);
   }
   else
   {
-    printf("Unimplemmented PPU write @ 0x%04X\n", addr);
+    LOG_WARNING(PPU, "Unimplemented PPU write @ 0x%04X", addr);
     assert(0);
   }
 }
 
+void PPU::note_mid_frame_scroll()
+{
+  // Only a game splitting the screen writes the scroll while the picture is being drawn.
+  if (backend == PPUBackend::Auto && rendering_enabled() && pixel_y < HEIGHT)
+    auto_accurate_frames = AUTO_ACCURATE_FRAMES;
+}
+
+void PPU::increment_vram_addr()
+{
+  // While the accurate backend is rendering, v is busy being the scroll position, and a
+  // $2007 access bumps it as the fetches would: coarse X and Y at once.
+  if (loopy_frame && rendering_enabled() && (pixel_y < HEIGHT || pixel_y == 261))
+  {
+    increment_scroll_x();
+    increment_scroll_y();
+    return;
+  }
+
+  // Auto-increment the internal VRAM pointer by an amount
+  // specified in PPUCTRL
+  u8 addr_increment = (PPUCTRL & 0b100) ? 32 : 1;
+  vram_addr = (vram_addr + addr_increment) & 0x7FFF;
+}
+
+void PPU::write_vram(u16 mirrored_addr, u8 val)
+{
+  vram[mirrored_addr] = val;
+  if (mirrored_addr < 0x2000 && vram_tiles.IsAttached())
+    vram_tiles.Invalidate(mirrored_addr >> 4);
+
+  if (mirrored_addr >= 0x3F00)
+    line_palette_dirty = true;
+  else
+    note_background_write(mirrored_addr);
+}
+
+void PPU::note_background_write(u16 mirrored_addr)
+{
+  if (mirrored_addr < 0x2000)
+  {
+    // Which cells use the tile is worked out when the layer is next needed.
+    background_written_tiles[mirrored_addr >> 4] = 1;
+    background_tiles_written = true;
+    return;
+  }
+
+  // The byte shows up in every nametable mapped onto its page.
+  const u8 *page = vram + (mirrored_addr & ~0x3FF);
+  const int offset = mirrored_addr & 0x3FF;
+
+  for (int nametable = 0; nametable < 4; ++nametable)
+  {
+    if (nametable_pages[nametable] != page)
+      continue;
+
+    const int base_cell_x = 32 * (nametable & 1);
+    const int base_cell_y = 30 * (nametable >> 1);
+
+    if (offset < 0x3C0)
+    {
+      background_dirty[base_cell_y + offset / 32] |= 1ull << (base_cell_x + offset % 32);
+    }
+    else
+    {
+      // Attribute bytes cover 4x4 cells (the last row of them only 4x2).
+      const int attribute_index = offset - 0x3C0;
+      const int first_row = 4 * (attribute_index / 8);
+      for (int row = first_row; row < first_row + 4 && row < 30; ++row)
+        background_dirty[base_cell_y + row] |= 0xFull << (base_cell_x + 4 * (attribute_index % 8));
+    }
+  }
+}
+
+void PPU::update_background_layer()
+{
+  if (!background_layer)
+  {
+    background_layer.reset(new u8[512 * 480]);
+    mark_background_dirty();
+  }
+
+  const bool table = BGPatternTableAddress;
+  const CHRSlot *slots = &chr_slots[table ? 4 : 0];
+
+  bool inputs_changed = table != background_table ||
+                        memcmp(nametable_pages, background_pages, sizeof(background_pages)) != 0;
+  for (int slot = 0; slot < 4; ++slot)
+    inputs_changed = inputs_changed || slots[slot].cache != background_slots[slot].cache ||
+                     slots[slot].first_tile != background_slots[slot].first_tile;
+
+  if (inputs_changed)
+  {
+    mark_background_dirty();
+    background_table = table;
+    memcpy(background_slots, slots, sizeof(background_slots));
+    memcpy(background_pages, nametable_pages, sizeof(background_pages));
+  }
+
+  if (background_tiles_written)
+  {
+    // Which background tiles were written...
+    bool tile_written[256];
+    bool any_written = false;
+    for (int tile = 0; tile < 256; ++tile)
+    {
+      tile_written[tile] = background_written_tiles[(table ? 256 : 0) + tile];
+      any_written = any_written || tile_written[tile];
+    }
+
+    // ...and which cells use them.
+    if (any_written && !inputs_changed)
+      for (int nametable = 0; nametable < 4; ++nametable)
+        for (int entry = 0; entry < 960; ++entry)
+          if (tile_written[ppuRead(0x2000 + 0x400 * nametable + entry)])
+            background_dirty[30 * (nametable >> 1) + entry / 32] |= 1ull << (32 * (nametable & 1) + entry % 32);
+
+    memset(background_written_tiles, 0, sizeof(background_written_tiles));
+    background_tiles_written = false;
+  }
+}
+
+void PPU::clean_background_cells(int cell_y, int first_cell, int last_cell)
+{
+  u64 &dirty = background_dirty[cell_y];
+  if (!dirty)
+    return;
+
+  // Cell numbers past 63 wrap around to the left edge.
+  for (int cell = first_cell; cell <= last_cell; ++cell)
+  {
+    const int cell_x = cell & 63;
+    if (dirty & (1ull << cell_x))
+    {
+      fetch_background_tile(8 * cell_x, 8 * cell_y, &background_layer[512 * 8 * cell_y + 8 * cell_x], 8, 512);
+      dirty &= ~(1ull << cell_x);
+    }
+  }
+}
+
 void PPU::Clock()
 {
-  const u16 PRE_RENDER_SCANLINE = 261;
-  //const u16 FIRST_VISIBLE_SCANLINE = 0;
-  //const u16 LAST_VISIBLE_SCANLINE = 239;
-  //const u16 POST_RENDER_SCANLINE = 240;
-  const u16 FIRST_VERTICAL_BLANK_LINE = 241;
-  //const u16 LAST_VERTICAL_BLANK_LINE = 260;
+  Run(1);
+}
 
-  // The second tick of scanline 241 sets VBlank flag, and also triggers NMI
-  if (pixel_y == FIRST_VERTICAL_BLANK_LINE && pixel_x == 1)
+void PPU::Run(int dots)
+{
+  // NMI is raised whenever VBlank and NMI generation are both on and it has not been
+  // raised yet for this VBlank. Between dot actions only the CPU changes either, and it
+  // does not run until we return, so checking here and after the actions is enough. (A
+  // game that does not read PPUSTATUS to clear VBlank can toggle GenerateNMI several
+  // times and get several NMIs.)
+  check_nmi();
+
+  while (dots > 0)
   {
-    VerticalBlank = 1;
-    printf("scanline %u -- PPUSTATUS = 0x%02X, PPUCTRL = 0x%02X\n", pixel_y, PPUSTATUS, PPUCTRL);
+    const PPUDotSpan &span = PPU_TIMING.Find(pixel_y, pixel_x);
+    const int count = std::min(dots, span.dot + span.length - pixel_x);
+
+    if (span.actions)
+      run_dot_actions(span.actions);
+
+    if (loopy_frame && (PPU_TIMING.line_actions[pixel_y] & LINE_RENDERED))
+    {
+      // The accurate backend works through the fetch schedule a dot at a time, on the
+      // visible lines and the pre-render line that sets up the first of them.
+      for (int i = 0; i < count; ++i, ++pixel_x)
+        clock_loopy();
+    }
+    else
+    {
+      // Otherwise nothing happens between actions, except sprite-0 hit, which is still
+      // reported at the dot it happens on.
+      if (sprite_zero_hit_x >= pixel_x && sprite_zero_hit_x < pixel_x + count && pixel_y < HEIGHT)
+      {
+        SpriteZeroHit = 1;
+        sprite_zero_hit_x = -1;
+      }
+      pixel_x += count;
+    }
+    dots -= count;
+
+    // With rendering on, odd frames are one dot shorter: the accurate backend skips the
+    // last dot of the pre-render line.
+    if ((span.actions & DOT_ODD_FRAME_SKIP) && loopy_frame && odd_frame && rendering_enabled())
+      pixel_x++;
+
+    // The scanline counter's IRQ comes once the dot that clocks it is done. The CPU only
+    // sees it when we return, so there is no need to stop exactly there.
+    if (frame_position() > scanline_irq_position)
+    {
+      SyncScanlineCounter();
+      ScheduleScanlineIRQ();
+    }
+
+    if (pixel_x == PPU_DOTS_PER_LINE)
+      start_line();
   }
+}
+
+u32 PPU::frame_position() const
+{
+  return PPU_DOTS_PER_LINE * pixel_y + pixel_x;
+}
+
+int PPU::scanline_counter_dot() const
+{
+  if (!rendering_enabled())
+    return -1;
+
+  // 8x16 sprites pick their table by tile number, but the unused sprite slots on a line
+  // fetch from $1000, so this treats them as being there.
+  const bool sprites_high = SpriteSize || SpritePatternTableAddress;
+  if (sprites_high == (bool)BGPatternTableAddress)
+    return -1;
+  return sprites_high ? PPU_A12_SPRITE_FETCH_DOT : PPU_A12_BACKGROUND_FETCH_DOT;
+}
+
+void PPU::SyncScanlineCounter()
+{
+  if (!scanline_counter)
+    return;
+
+  const u32 now = frame_position();
+  const int dot = scanline_counter_dot();
+  if (dot >= 0)
+  {
+    const u32 clocks = CountScanlineClocksBefore(now, dot) - CountScanlineClocksBefore(scanline_counter_synced, dot);
+    if (clocks)
+      cart->ClockScanlineCounter(clocks);
+  }
+  scanline_counter_synced = now;
+}
+
+void PPU::ScheduleScanlineIRQ()
+{
+  if (!scanline_counter)
+    return;
+
+  bus->SetCartridgeIRQ(cart->IsIRQAsserted());
 
-  // This is separated from when we enter Vertical Blank, because if a user does not
-  // read PPUSTATUS to clear VerticalBlank flag, they can toggle GenerateNMI multiple
-  // times and generate multiple NMIs. This code allows that to happen.
+  // The clock the IRQ comes on, counting from the first in the frame; one in a later frame
+  // is scheduled when that frame starts.
+  scanline_irq_position = NO_SCANLINE_IRQ;
+  const u32 clocks = cart->GetScanlineClocksUntilIRQ();
+  const int dot = scanline_counter_dot();
+  if (!clocks || dot < 0)
+    return;
+
+  const u32 clock = CountScanlineClocksBefore(scanline_counter_synced, dot) + clocks - 1;
+  if (clock < PPU_VISIBLE_LINES)
+    scanline_irq_position = PPU_DOTS_PER_LINE * clock + dot;
+  else if (clock == PPU_VISIBLE_LINES)
+    scanline_irq_position = PPU_DOTS_PER_LINE * PPU_PRE_RENDER_LINE + dot;
+}
 
+void PPU::check_nmi()
+{
   if (VerticalBlank && GenerateNMIOnVBI && nmi_latch == 0)
   {
     nmi_latch = 1;
     bus->TriggerNMI();
   }
+}
 
-  if (pixel_y == PRE_RENDER_SCANLINE && pixel_x == 1)
+void PPU::run_dot_actions(u8 actions)
+{
+  // The second tick of scanline 241 sets VBlank flag, and also triggers NMI
+  if (actions & DOT_VBLANK_SET)
+  {
+    VerticalBlank = 1;
+    LOG_DEBUG(PPU, "scanline %u -- PPUSTATUS = 0x%02X, PPUCTRL = 0x%02X", pixel_y, PPUSTATUS, PPUCTRL);
+    check_nmi();
+  }
+
+  if (actions & DOT_VBLANK_CLEAR)
   {
     VerticalBlank = 0;
     SpriteZeroHit = 0;
+    SpriteOverflow = 0;
     nmi_latch = 0; // Reset NMI latch
   }
 
-  render_pixel();
-
-  // Advance pixels/scanlines
-  pixel_x++;
-  if (pixel_x == 341)
+  // Visible lines are rendered in one go at the start of the line, using the registers as
+  // they are at that dot, unless the accurate backend is drawing them.
+  if (actions & DOT_LINE_START)
   {
-    pixel_x = 0;
-    pixel_y++;
+    if (replay)
+      log_scanline();
 
-    if (pixel_y == 33)
+    if (!loopy_frame)
     {
-      printf("scanline %d -- S0 :: %02X %02X %02X %02X --- SX/SY :: %d %d\n", pixel_y, OAM_RAM[0], OAM_RAM[1], OAM_RAM[2], OAM_RAM[3], scroll_x, scroll_y);
+      if (replay || skipping_frame_output)
+        evaluate_scanline_flags();
+      else
+        render_scanline();
     }
-
-    if (pixel_y == 2)
+    else if (!indexed_frame && !skipping_frame_output)
     {
-      render_pattern_tables();
-      render_nametables();
+      allocate_frame();
     }
+  }
+}
+
+void PPU::start_line()
+{
+  pixel_x = 0;
+  pixel_y++;
+  if (pixel_y == PPU_LINES_PER_FRAME)
+  {
+    // Frame positions start over.
+    SyncScanlineCounter();
+    pixel_y = 0;
+    scanline_counter_synced = 0;
+    ScheduleScanlineIRQ();
+  }
+
+  const u8 actions = PPU_TIMING.line_actions[pixel_y];
 
-    if (pixel_y == PRE_RENDER_SCANLINE)
+  if (actions & LINE_DEBUG_PRINT)
+    LOG_DEBUG(PPU, "scanline %d -- S0 :: %02X %02X %02X %02X --- SX/SY :: %d %d", pixel_y, OAM_RAM[0], OAM_RAM[1], OAM_RAM[2], OAM_RAM[3], scroll_x, scroll_y);
+
+  if (actions & LINE_FRAME_END)
+  {
+    if (replay && (skipping_frame_output || loopy_frame))
     {
-      endFrameCallBack();
+      // Nothing to wait for; the shadow only has to keep up with the state.
+      replay->CatchUp(render_log);
     }
-
-    if (pixel_y == PRE_RENDER_SCANLINE + 1)
+    else if (replay)
     {
-      pixel_y = 0;
+      log_event(PPULogEvent::FrameEnd, 0, 0);
+      replay->FinishFrame(render_log, indexed_frame);
+      rgb_frame_stale = true;
+      finish_lines(0, HEIGHT);
     }
+    publish_frame_hashes();
+    apply_render_mode();
+
+    // Pick the backend for the next frame. The accurate one starts drawing on this line.
+    loopy_frame = backend == PPUBackend::Accurate || (backend == PPUBackend::Auto && auto_accurate_frames > 0);
+    if (auto_accurate_frames > 0)
+      auto_accurate_frames--;
+
+    endFrameCallBack();
+  }
+
+  if (actions & LINE_FRAME_START)
+  {
+    skipping_frame_output = skip_frame_output;
+    odd_frame = !odd_frame;
   }
 }
 
 void PPU::render_nametables()
 {
+  DebugViewChanges &changes = nametable_view_changes;
+  check_debug_view_inputs(changes);
+
   u8 *nt_data = nametables.Data();
 
   // PPUCTRL marks whether the background tiles from from the 'left' or 'right' pattern tables.
   const u16 bg_pattern_base = BGPatternTableAddress ? 0x1000 : 0x0000;
 
-  // We fill up the entire texture, which is comprised of data from all four nametables
-  // Because the data is arranged in chunks of 8 horizontal pixels in a row, we'll fetch
-  // data for the next 8 pixels, and draw that into our texture before going onto the
-  // next 8 pixels.
-  for (int j = 0; j < 240 * 2; j += 1)
-    for (int i = 0; i < 256 * 2; i += 8)
+  // The picture itself comes from the background layer the renderer keeps.
+  update_chr_slots();
+  update_background_layer();
+
+  // The view window outline drawn last time covers pixels in these cells, so they need to
+  // be drawn again even if nothing under them changed.
+  const int ppu_scroll_x = scroll_x + ((PPUCTRL >> 0) & 1 ? 256 : 0);
+  const int ppu_scroll_y = scroll_y + ((PPUCTRL >> 1) & 1 ? 240 : 0);
+
+  u8 redraw[60][64] = {};
+  if (changes.window_drawn && (changes.window_x != ppu_scroll_x || changes.window_y != ppu_scroll_y))
+  {
+    const auto mark = [&](int i, int j) {
+      redraw[((j + changes.window_y) % 480) / 8][((i + changes.window_x) % 512) / 8] = 1;
+    };
+    for (int i = 0; i < 256; ++i)
+    {
+      mark(i, 0);
+      mark(i, 239);
+    }
+    for (int j = 0; j < 240; ++j)
     {
-      // (i,j) position within the full space of the nametables.
+      mark(0, j);
+      mark(255, j);
+    }
+  }
 
-      int nametable_tile_x = (i / 8) % 32;
-      int nametable_tile_y = (j / 8) % 30;
+  // We fill up the entire texture, which is comprised of data from all four nametables,
+  // one 8x8 cell at a time, skipping cells whose nametable entry, attribute byte and
+  // pattern are unchanged since last time.
+  for (int cell_y = 0; cell_y < 60; ++cell_y)
+    for (int cell_x = 0; cell_x < 64; ++cell_x)
+    {
+      const int i = 8 * cell_x;
+      const int j = 8 * cell_y;
+
+      int nametable_tile_x = cell_x % 32;
+      int nametable_tile_y = cell_y % 30;
 
       const u8 which_nametable = (i / 256) + 2 * (j / 240);
       u16 nametable_start = 0x2000 + 0x400 * which_nametable;
       u16 nt_byte_addr = nametable_start + 32 * nametable_tile_y + nametable_tile_x; //(nametable_tile_y * 32 + nametable_tile_x);
+      u8 attribute_index = (nametable_tile_y / 4) * 8 + (nametable_tile_x / 4);
+      u16 attribute_addr = nametable_start + 0x3C0 + attribute_index;
+
       u16 pattern_table_index = ppuRead(nt_byte_addr);
+      const u16 pattern_addr = bg_pattern_base | (pattern_table_index << 4);
 
-      u8 lo_bits = ppuRead(bg_pattern_base | (pattern_table_index << 4) | 0b0000 | (j & 7));
-      u8 hi_bits = ppuRead(bg_pattern_base | (pattern_table_index << 4) | 0b1000 | (j & 7));
+      const bool changed = changes.all || redraw[cell_y][cell_x] ||
+                           changes.nametable_bytes[NametableMirroring(nt_byte_addr) & 0xFFF] ||
+                           changes.nametable_bytes[NametableMirroring(attribute_addr) & 0xFFF] ||
+                           changes.tiles[pattern_addr >> 4];
+      if (!changed)
+        continue;
 
-      u8 attribute_index = (nametable_tile_y / 4) * 8 + (nametable_tile_x / 4);
-      u8 attribute_byte = ppuRead(nametable_start + 0x3C0 + attribute_index);
-      u8 attribute_bits = ((i % 32) / 16) * 2 + ((j % 32) / 16) * 4;
-      u8 bg_pal_numb = (attribute_byte >> attribute_bits) & 0b11;
+      clean_background_cells(cell_y, cell_x, cell_x);
 
-      for (int fine_x = i; fine_x < i + 8; ++fine_x)
+      for (int y = j; y < j + 8; ++y)
       {
-        u8 lo_bit = (lo_bits >> (7 - fine_x & 7)) & 1;
-        u8 hi_bit = (hi_bits >> (7 - fine_x & 7)) & 1;
-        u8 bg_color_index = lo_bit | (hi_bit << 1);
+        const u8 *layer_row = &background_layer[512 * y];
 
-        u8 master_color_index = ppuRead(0x3F00 + 4 * bg_pal_numb + bg_color_index);
+        for (int fine_x = i; fine_x < i + 8; ++fine_x)
+        {
+          u8 master_color_index = ppuRead(0x3F00 + layer_row[fine_x]) & 0x3F;
 
-        u8 r = PALETTE_BYTES[3 * master_color_index + 0];
-        u8 g = PALETTE_BYTES[3 * master_color_index + 1];
-        u8 b = PALETTE_BYTES[3 * master_color_index + 2];
+          u8 r = PALETTE_BYTES[3 * master_color_index + 0];
+          u8 g = PALETTE_BYTES[3 * master_color_index + 1];
+          u8 b = PALETTE_BYTES[3 * master_color_index + 2];
 
-        // Outline the 4 screens
-        if (fine_x == 256 || j == 240)
-        {
-          r = g = b = 255;
-        }
+          // Outline the 4 screens
+          if (fine_x == 256 || y == 240)
+          {
+            r = g = b = 255;
+          }
 
-        const int pixel_num = 512 * j + fine_x;
-        nt_data[3 * pixel_num + 0] = r;
-        nt_data[3 * pixel_num + 1] = g;
-        nt_data[3 * pixel_num + 2] = b;
+          const int pixel_num = 512 * y + fine_x;
+          nt_data[3 * pixel_num + 0] = r;
+          nt_data[3 * pixel_num + 1] = g;
+          nt_data[3 * pixel_num + 2] = b;
+        }
       }
     }
 
   // Draw the window into the namespaces
-  const int ppu_scroll_x = scroll_x + ((PPUCTRL >> 0) & 1 ? 256 : 0);
-  const int ppu_scroll_y = scroll_y + ((PPUCTRL >> 1) & 1 ? 240 : 0);
-
   for (int i = 0; i < 256; ++i)
     for (int j = 0; j < 240; ++j)
     {
@@ -364,17 +835,18 @@ void PPU::render_nametables()
         nt_data[3 * pixel_num + 2] = 255;
       }
     }
+
+  changes.Clear();
+  changes.window_drawn = true;
+  changes.window_x = ppu_scroll_x;
+  changes.window_y = ppu_scroll_y;
 }
 
 u16 PPU::NametableMirroring(u16 addr)
 {
   if (addr >= 0x2000 && addr < 0x3F00)
   {
-    bool is_horizontal = cart->GetDescription().HardwiredMirroringModeIsVertical;
-    if (is_horizontal)
-      return (addr < 0x2800) ? (0x2000 | (addr & 0x3FF)) : (0x2800 | (addr & 0x3FF));
-    else
-      return addr & 0xF7FF;
+    return (nametable_pages[(addr >> 10) & 3] - vram) + (addr & 0x3FF);
   }
   else
     return addr;
@@ -395,7 +867,7 @@ u8 PPU::ppuRead(u16 addr)
   }
   else if (addr < 0x3F00)
   {
-    return vram[NametableMirroring(addr & 0x2FFF)];
+    return nametable_pages[(addr >> 10) & 3][addr & 0x3FF];
   }
   else if (addr < 0x4000)
   {
@@ -412,6 +884,158 @@ u8 PPU::ppuRead(u16 addr)
   }
 }
 
+void PPU::update_chr_slots()
+{
+  // A shadow PPU gets its slots from the log, as of the line being drawn.
+  if (replaying)
+    return;
+
+  const Cartridge *current = cart.get();
+  if (cart->GetCHRDirtyPages())
+    take_chr_writes();
+
+  if (current == chr_slots_cart && current->GetCHRBankSerial() == chr_slots_serial)
+    return;
+
+  if (current != chr_slots_cart)
+  {
+    attach_cart_tiles(current->GetCHRMemory());
+    chr_slots_cart = current;
+  }
+  chr_slots_serial = current->GetCHRBankSerial();
+
+  for (int slot = 0; slot < 8; ++slot)
+  {
+    u32 offset;
+    if (current->MapCHR(0x400 * slot, offset))
+      chr_slots[slot] = {&cart_tiles, offset / 16};
+    else
+      chr_slots[slot] = {get_vram_tiles(), 64u * slot};
+  }
+}
+
+void PPU::attach_cart_tiles(const u8 *chr)
+{
+  // CHR-ROM comes decoded already, shared by every console running the ROM.
+  const TileCache *shared = cart->GetCHRROMTiles();
+  if (shared && chr == cart->GetCHRMemory())
+    cart_tiles.Share(*shared);
+  else
+    cart_tiles.Attach(chr, cart->GetCHRMemorySize());
+}
+
+TileCache *PPU::get_vram_tiles()
+{
+  // Only boards that leave pattern tables unmapped use it, so it is made on first use.
+  if (!vram_tiles.IsAttached())
+    vram_tiles.Attach(vram, 0x2000);
+  return &vram_tiles;
+}
+
+void PPU::take_chr_writes()
+{
+  for (u64 pages = cart->GetCHRDirtyPages(); pages; pages &= pages - 1)
+  {
+    const int page = __builtin_ctzll(pages);
+    for (u64 tiles = cart->TakeCHRDirtyTiles(page); tiles; tiles &= tiles - 1)
+      note_chr_tile_write(64 * page + __builtin_ctzll(tiles));
+  }
+}
+
+void PPU::note_chr_tile_write(u32 tile)
+{
+  // Only this tile needs decoding again, and only the pattern table tiles showing it need
+  // drawing again; with CHR-RAM mapped twice, there can be more than one.
+  cart_tiles.Invalidate(tile);
+  for (int slot = 0; slot < 8; ++slot)
+  {
+    if (chr_slots[slot].cache != &cart_tiles || tile - chr_slots[slot].first_tile >= 64)
+      continue;
+
+    const u16 addr = 0x400 * slot + 16 * (tile - chr_slots[slot].first_tile);
+    note_background_write(addr);
+    if (debug_textures_allocated)
+      note_debug_view_write(addr);
+  }
+}
+
+void PPU::finish_lines(int first_line, int count)
+{
+  // A shadow PPU's lines are finished by the PPU it draws for, once it has the frame.
+  if (replaying)
+    return;
+
+  for (int line = first_line; line < first_line + count; ++line)
+  {
+    const u16 *pixels = GetIndexedFrameBuffer() + WIDTH * line;
+    line_hashes[line] = hash_line(pixels);
+    if (frame_output)
+      ConvertIndexedPixels(pixels, frame_output + line * frame_output_pitch, WIDTH, frame_output_format);
+  }
+}
+
+void PPU::allocate_frame()
+{
+  indexed_frame.reset(new u16[WIDTH * HEIGHT]());
+}
+
+const u16 *PPU::GetIndexedFrameBuffer() const
+{
+  return indexed_frame ? indexed_frame.get() : BLANK_FRAME;
+}
+
+void PPU::publish_frame_hashes()
+{
+  memset(dirty_lines, 0, sizeof(dirty_lines));
+  dirty_line_count = 0;
+  frame_hash = FRAME_HASH_SEED;
+
+  for (int line = 0; line < HEIGHT; ++line)
+  {
+    if (line_hashes[line] != frame_line_hashes[line])
+    {
+      dirty_lines[line >> 6] |= 1ull << (line & 63);
+      dirty_line_count++;
+      frame_line_hashes[line] = line_hashes[line];
+    }
+
+    frame_hash = mix_frame_hash(frame_hash, line_hashes[line]);
+  }
+}
+
+void PPU::SetFrameOutput(void *pixels, int pitch, PixelFormat format)
+{
+  frame_output = (u8 *)pixels;
+  frame_output_pitch = pitch;
+  frame_output_format = format;
+
+  if (frame_output)
+    for (int line = 0; line < HEIGHT; ++line)
+      ConvertIndexedPixels(GetIndexedFrameBuffer() + WIDTH * line, frame_output + line * frame_output_pitch, WIDTH, frame_output_format);
+}
+
+Texture &PPU::GetFrameBufferTexture()
+{
+  if (frame_buffer.GetWidth() == 0)
+    frame_buffer.Resize(WIDTH, HEIGHT);
+
+  if (rgb_frame_stale)
+  {
+    ConvertIndexedToRGB(GetIndexedFrameBuffer(), frame_buffer.Data(), WIDTH * HEIGHT);
+    rgb_frame_stale = false;
+  }
+  return frame_buffer;
+}
+
+void PPU::update_line_palette()
+{
+  // Greyscale keeps only the brightness column of each color.
+  const u8 color_mask = Greyscale ? 0x30 : 0x3F;
+  for (int i = 0; i < 32; ++i)
+    line_palette.colors[i] = ppuRead(0x3F00 + i) & color_mask;
+  line_palette_dirty = false;
+}
+
 void PPU::render_pattern_tables()
 {
   // Pattern table entries
@@ -425,203 +1049,456 @@ void PPU::render_pattern_tables()
   // |+-------------- H: Half of sprite table (0: "left"; 1: "right")
   // +--------------- 0: Pattern table is at $0000-$1FFF
 
+  DebugViewChanges &changes = pattern_view_changes;
+  check_debug_view_inputs(changes);
+
   Texture *pattern_textures[2] = {&pattern_left, &pattern_right};
 
-  for (int left_right = 0; left_right < 2; ++left_right)
+  update_chr_slots();
+
+  for (int tile = 0; tile < 512; ++tile)
   {
+    if (!changes.all && !changes.tiles[tile])
+      continue;
+
+    const int left_right = tile >> 8;
+    const int tile_row_index = (tile >> 4) & 15;
+    const int tile_col = tile & 15;
     u8 *pattern_texture_data = pattern_textures[left_right]->Data();
 
-    for (int j = 0; j < 128; ++j)
+    for (int fine_y = 0; fine_y < 8; ++fine_y)
     {
-      u16 tile_row = j / 8;
-      u16 fine_y = j & 7;
+      const u8 *row = tile_row((tile << 4) | fine_y, false);
+      const int j = 8 * tile_row_index + fine_y;
 
-      for (int i = 0; i < 128; ++i)
+      for (int fine_x = 0; fine_x < 8; ++fine_x)
       {
-        u16 tile_col = i / 8;
-        u16 fine_x = 7 - (i & 7);
-
-        auto chrrom = [&](u16 addr) -> u8 { u8 val; return bus->GetCartridge()->PPURead(addr, val)? val : 0; };
-
-        u8 lo_bit = (chrrom((left_right << 12) | (tile_row << 8) | (tile_col << 4) | 0b0000 | fine_y) >> fine_x) & 1;
-        u8 hi_bit = (chrrom((left_right << 12) | (tile_row << 8) | (tile_col << 4) | 0b1000 | fine_y) >> fine_x) & 1;
-
-        u8 pix_color = lo_bit | (hi_bit << 1);
+        u8 pix_color = row[fine_x];
         u8 palette_number = 0;
-        u8 color_index = vram[pix_color == 0 ? 0x3F00 : 0x3F01 + 4 * palette_number + pix_color];
+        u8 color_index = vram[pix_color == 0 ? 0x3F00 : 0x3F01 + 4 * palette_number + pix_color] & 0x3F;
 
         u8 r = PALETTE_BYTES[3 * color_index + 0];
         u8 g = PALETTE_BYTES[3 * color_index + 1];
         u8 b = PALETTE_BYTES[3 * color_index + 2];
 
-        u16 ptr_base = 3 * (j * 128 + i);
+        u16 ptr_base = 3 * (j * 128 + 8 * tile_col + fine_x);
         pattern_texture_data[ptr_base + 0] = r;
         pattern_texture_data[ptr_base + 1] = g;
         pattern_texture_data[ptr_base + 2] = b;
       }
     }
   }
+
+  changes.Clear();
 }
 
-void PPU::render_pixel()
+void PPU::check_debug_view_inputs(DebugViewChanges &changes)
 {
-  u8 *pixels = frame_buffer.Data();
-  if (pixel_x >= WIDTH || pixel_y >= HEIGHT)
-    return;
+  const Cartridge *current = cart.get();
+  const u32 chr_serial = current->GetCHRBankSerial();
+  const MirroringMode mirroring = current->GetMirroring();
+  const bool bg_pattern_table = BGPatternTableAddress;
 
-  ////////////////////////////////////////////////////
-
-  u8 master_palette_index_bg = ppuRead(0x3F00);
+  if (changes.cart != current || changes.chr_serial != chr_serial ||
+      changes.mirroring != mirroring || changes.bg_pattern_table != bg_pattern_table)
+  {
+    changes.all = true;
+    changes.cart = current;
+    changes.chr_serial = chr_serial;
+    changes.mirroring = mirroring;
+    changes.bg_pattern_table = bg_pattern_table;
+  }
+}
 
-  // Get background color
-  int ppu_scroll_x = scroll_x + (((PPUCTRL >> 0) & 1) ? 256 : 0);
-  int ppu_scroll_y = scroll_y + (((PPUCTRL >> 1) & 1) ? 240 : 0);
+void PPU::note_debug_view_write(u16 addr)
+{
+  if (addr < 0x2000)
+  {
+    pattern_view_changes.tiles[addr >> 4] = 1;
+    nametable_view_changes.tiles[addr >> 4] = 1;
+  }
+  else if (addr < 0x3F00)
+  {
+    nametable_view_changes.nametable_bytes[NametableMirroring(addr) & 0xFFF] = 1;
+  }
+  else
+  {
+    pattern_view_changes.all = true;
+    nametable_view_changes.all = true;
+  }
+}
 
-  int nametable_x = (ppu_scroll_x + pixel_x) % 512;
-  int nametable_y = (ppu_scroll_y + pixel_y) % 480;
+#pragma pack(push)
+#pragma pack(1)
+struct SpriteData
+{
+  u8 y;
+  u8 tile_index;
+  u8 attributes;
+  u8 x;
+};
+#pragma pack(pop)
 
-  u16 which_nametable = 0;
-  if (nametable_x >= 256)
+void PPU::evaluate_sprites(int line)
+{
+  // Are we drawing 8x16 sprites?
+  const int sprite_height = (PPUCTRL & 0x20) ? 16 : 8;
+
+  // Test all 64 Y coordinates without branches and collect the hits in a bitmask. A sprite
+  // covers this line when (line - (y + 1)) lands in [0, height); done as an unsigned
+  // compare so sprites below the line wrap around to large values. The loop has no
+  // dependencies between iterations, so the compiler is free to vectorize it.
+  u64 in_range = 0;
+  for (int sprite_i = 0; sprite_i < 64; ++sprite_i)
   {
-    which_nametable += 1;
-    nametable_x -= 256;
+    const u32 row = (u32)(line - (OAM_RAM[4 * sprite_i] + 1));
+    in_range |= (u64)(row < (u32)sprite_height) << sprite_i;
   }
 
-  if (nametable_y >= 240)
+  // Copy the first 8 (in OAM order) into secondary OAM. Hardware has a bug in how it
+  // looks for a ninth sprite, but the common case of "more than 8 on a line" sets the flag.
+  secondary_oam_count = 0;
+  sprite_zero_in_secondary_oam = in_range & 1;
+
+  while (in_range && secondary_oam_count < 8)
   {
-    which_nametable += 2;
-    nametable_y -= 240;
+    const int sprite_i = __builtin_ctzll(in_range);
+    in_range &= in_range - 1;
+    memcpy(&secondary_OAM[4 * secondary_oam_count], &OAM_RAM[4 * sprite_i], 4);
+    secondary_oam_count++;
   }
 
-  u8 bg_color_index = 0;
+  if (in_range)
+    SpriteOverflow = 1;
+}
+
+const u8 *PPU::sprite_row(const u8 *sprite, int line)
+{
+  const SpriteData *sprite_data = (const SpriteData *)sprite;
+  int sprite_pattern_y = line - (sprite_data->y + 1);
+
+  const bool sprite_flip_horizontal = sprite_data->attributes & 0x40;
+  const bool sprite_flip_vertical = sprite_data->attributes & 0x80;
 
-  // Background
-  if (ShowBackground && (ShowBGInLeftMost || pixel_x >= 8))
+  u16 sprite_pattern_data_address = SpritePatternTableAddress ? 0x1000 : 0x0000;
+  u16 tile_index = sprite_data->tile_index;
+
+  if (PPUCTRL & 0x20) // 8x16
   {
-    int nametable_tile_x = nametable_x / 8;
-    int nametable_tile_y = nametable_y / 8;
+    int which_tile = (sprite_pattern_y >= 8) ? 1 : 0;
+    if (sprite_flip_vertical)
+      which_tile = 1 - which_tile;
 
-    u16 nametable_start = 0x2000 + 0x400 * which_nametable;
-    u16 nt_byte_addr = nametable_start + 32 * nametable_tile_y + nametable_tile_x; //(nametable_tile_y * 32 + nametable_tile_x);
-    u16 pattern_table_index = ppuRead(nt_byte_addr);
+    sprite_pattern_data_address = (tile_index & 1) ? 0x1000 : 0x0000;
+    tile_index = (tile_index & 0xFE) + which_tile;
+  }
 
-    u8 fine_x = nametable_x & 7;
-    u8 fine_y = nametable_y & 7;
+  if (sprite_flip_vertical)
+    sprite_pattern_y = 7 - sprite_pattern_y;
+  sprite_pattern_y &= 0b111;
 
-    // PPUCTRL marks whether the background tiles from from the 'left' or 'right' pattern tables.
-    u16 bg_pattern_base = BGPatternTableAddress ? 0x1000 : 0x0000;
+  return tile_row(sprite_pattern_data_address | (tile_index << 4) | sprite_pattern_y, sprite_flip_horizontal);
+}
 
-    u8 lo_bit = (ppuRead(bg_pattern_base | (pattern_table_index << 4) | 0b0000 | fine_y) >> (7 - fine_x)) & 1;
-    u8 hi_bit = (ppuRead(bg_pattern_base | (pattern_table_index << 4) | 0b1000 | fine_y) >> (7 - fine_x)) & 1;
-    bg_color_index = lo_bit | (hi_bit << 1);
+void PPU::render_sprite_line(int line)
+{
+  // Walk secondary OAM backwards so that lower-numbered sprites overwrite higher-numbered
+  // ones, which gives the front-most opaque sprite at each pixel, as the hardware does.
+  for (int slot = secondary_oam_count - 1; slot >= 0; --slot)
+  {
+    const SpriteData *sprite_data = (SpriteData *)&secondary_OAM[4 * slot];
+    const u8 *row = sprite_row(&secondary_OAM[4 * slot], line);
 
-    // Which palette (from the attribute table at the end of this nametable)
-    u8 attribute_index = (nametable_tile_y / 4) * 8 + (nametable_tile_x / 4);
-    u8 attribute_byte = ppuRead(nametable_start + 0x3C0 + attribute_index);
-    u8 attribute_bits = ((nametable_x % 32) / 16) * 2 + ((nametable_y % 32) / 16) * 4;
-    u8 bg_pal_numb = (attribute_byte >> attribute_bits) & 0b11;
+    const u8 sprite_palette_num = sprite_data->attributes & 0x03;
+    const u8 flags = 0x10 | (sprite_palette_num << 2) |
+                     ((sprite_data->attributes & 0x20) ? SPRITE_BEHIND_BG : 0) |
+                     (slot == 0 && sprite_zero_in_secondary_oam ? SPRITE_ZERO : 0);
 
-    master_palette_index_bg = ppuRead(0x3F00 + 4 * bg_pal_numb + bg_color_index);
+    for (int i = 0; i < 8 && sprite_data->x + i < WIDTH; ++i)
+      if (row[i])
+        sprite_line[sprite_data->x + i] = flags | row[i];
   }
+}
 
-  // Get sprite color
-  u8 master_palette_index_sprite = 0;
-  u8 sprite_color_index = 0;
-  bool sprite_has_priority = false;
+i16 PPU::find_sprite_zero_hit()
+{
+  if (!ShowBackground || !ShowSprites || SpriteZeroHit || !sprite_zero_in_secondary_oam)
+    return -1;
 
-  if (ShowSprites && (ShowSpritesInLeftMost || pixel_x >= 8))
-  {
+  // Sprite 0 is in secondary OAM slot 0, and it has the highest priority, so its opaque
+  // pixels are never covered by another sprite. Only its 8 pixels need checking.
+  const u8 *row = sprite_row(&secondary_OAM[0], pixel_y);
+  const int sprite_zero_x = secondary_OAM[3];
+  const bool left_column_shown = ShowBGInLeftMost && ShowSpritesInLeftMost;
 
-#pragma pack(push)
-#pragma pack(1)
-    struct SpriteData
-    {
-      u8 y;
-      u8 tile_index;
-      u8 attributes;
-      u8 x;
-    };
-#pragma pack(pop)
+  const int ppu_scroll_x = scroll_x + (((PPUCTRL >> 0) & 1) ? 256 : 0);
+  const int ppu_scroll_y = scroll_y + (((PPUCTRL >> 1) & 1) ? 240 : 0);
+  const int nametable_y = (ppu_scroll_y + pixel_y) % 480;
 
-    // For each possible sprite, compute which pixel would land here
+  u8 tile[8];
+  int fetched_tile_x = -1;
 
-    // Are we drawing 8x16 sprites?
-    const bool mode816 = (PPUCTRL & 0x20) != 0;
-    const int sprite_height = mode816 ? 16 : 8;
+  for (int x = sprite_zero_x; x < sprite_zero_x + 8 && x < WIDTH - 1; ++x)
+  {
+    if (!row[x - sprite_zero_x] || (x < 8 && !left_column_shown))
+      continue;
 
-    for (int sprite_i = 0; sprite_i < 64; ++sprite_i)
+    // TODO : This is almost totally correct, but not quite
+    const int nametable_x = (ppu_scroll_x + x) % 512;
+    if ((nametable_x & ~7) != fetched_tile_x)
     {
-      const SpriteData *sprite_data = (SpriteData *)&OAM_RAM[4 * sprite_i];
-      u8 sprite_palette_num = sprite_data->attributes & 0x03;
-      bool sprite_flip_horizontal = sprite_data->attributes & 0x40;
-      bool sprite_flip_vertical = sprite_data->attributes & 0x80;
+      fetched_tile_x = nametable_x & ~7;
+      fetch_background_tile(fetched_tile_x, nametable_y, tile);
+    }
+    if (tile[nametable_x & 7] & 3)
+      return x;
+  }
+  return -1;
+}
 
-      if (sprite_data->x == 0)
-        continue;
+void PPU::fetch_background_tile(int nametable_x, int nametable_y, u8 *out, int rows, int out_stride)
+{
+  u16 which_nametable = 0;
+  if (nametable_y >= 240)
+  {
+    which_nametable = 2;
+    nametable_y -= 240;
+  }
+  if (nametable_x >= 256)
+  {
+    which_nametable += 1;
+    nametable_x -= 256;
+  }
 
-      int sprite_pattern_x = pixel_x - sprite_data->x;
-      int sprite_pattern_y = pixel_y - (sprite_data->y + 1);
+  const int nametable_tile_x = nametable_x / 8;
+  const int nametable_tile_y = nametable_y / 8;
+  const u16 nametable_start = 0x2000 + 0x400 * which_nametable;
+  const u16 pattern_table_index = ppuRead(nametable_start + 32 * nametable_tile_y + nametable_tile_x);
 
-      if (sprite_pattern_x >= 0 && sprite_pattern_x < 8)
-        if (sprite_pattern_y >= 0 && sprite_pattern_y < sprite_height)
-        {
-          u16 sprite_pattern_data_address = SpritePatternTableAddress ? 0x1000 : 0x0000;
-          u16 tile_index = sprite_data->tile_index;
+  // PPUCTRL marks whether the background tiles from from the 'left' or 'right' pattern tables.
+  const u16 bg_pattern_base = BGPatternTableAddress ? 0x1000 : 0x0000;
+  // Which palette (from the attribute table at the end of this nametable)
+  const u8 attribute_index = (nametable_tile_y / 4) * 8 + (nametable_tile_x / 4);
+  const u8 attribute_byte = ppuRead(nametable_start + 0x3C0 + attribute_index);
+  const u8 attribute_bits = ((nametable_x % 32) / 16) * 2 + ((nametable_y % 32) / 16) * 4;
+  const u8 bg_pal_numb = (attribute_byte >> attribute_bits) & 0b11;
 
-          int which_tile = 0;
-          if (mode816)
-          {
-            if (sprite_pattern_y >= 8)
-              which_tile = 1;
+  for (int fine_y = nametable_y & 7; rows > 0; ++fine_y, --rows, out += out_stride)
+  {
+    const u8 *row = tile_row(bg_pattern_base | (pattern_table_index << 4) | fine_y, false);
+    for (int i = 0; i < 8; ++i)
+      out[i] = row[i] ? (bg_pal_numb << 2) | row[i] : 0; // Color 0 is always the backdrop
+  }
+}
 
-            if (sprite_flip_vertical)
-              which_tile = 1 - which_tile;
+void PPU::render_scanline()
+{
+  // Background: the scroll window's row of the background layer, as palette indices
+  // (palette << 2 | color), after redrawing whichever cells under it are out of date.
+  u8 bg_line[WIDTH];
 
-            sprite_pattern_data_address = (tile_index & 1) ? 0x1000 : 0x0000;
-            tile_index = (tile_index & 0xFE) + which_tile;
-          }
+  update_chr_slots();
 
-          if (sprite_flip_horizontal)
-            sprite_pattern_x = 7 - sprite_pattern_x;
-          if (sprite_flip_vertical)
-            sprite_pattern_y = 7 - sprite_pattern_y;
+  if (ShowBackground)
+  {
+    const int ppu_scroll_x = scroll_x + (((PPUCTRL >> 0) & 1) ? 256 : 0);
+    const int ppu_scroll_y = scroll_y + (((PPUCTRL >> 1) & 1) ? 240 : 0);
 
-          sprite_pattern_x &= 0b111;
-          sprite_pattern_y &= 0b111;
+    const int nametable_y = (ppu_scroll_y + pixel_y) % 480;
+    const int first_x = ppu_scroll_x % 512;
 
-          u8 lo_bit = (ppuRead(sprite_pattern_data_address | (tile_index << 4) | 0b0000 | sprite_pattern_y) >> (7 - sprite_pattern_x)) & 1;
-          u8 hi_bit = (ppuRead(sprite_pattern_data_address | (tile_index << 4) | 0b1000 | sprite_pattern_y) >> (7 - sprite_pattern_x)) & 1;
-          sprite_color_index = lo_bit | (hi_bit << 1);
+    update_background_layer();
+    clean_background_cells(nametable_y / 8, first_x / 8, (first_x + WIDTH - 1) / 8);
 
-          master_palette_index_sprite = ppuRead(0x3F10 + 4 * sprite_palette_num + sprite_color_index);
-          sprite_has_priority = (sprite_data->attributes & 0x20) == 0;
+    // The window wraps around from the right edge of the layer to the left.
+    const u8 *layer_row = &background_layer[512 * nametable_y];
+    const int before_wrap = std::min(WIDTH, 512 - first_x);
+    memcpy(bg_line, layer_row + first_x, before_wrap);
+    memcpy(bg_line + before_wrap, layer_row, WIDTH - before_wrap);
+  }
+  else
+  {
+    memset(bg_line, 0, sizeof(bg_line));
+  }
 
-          // TODO : This is almost totally correct, but not quite
-          if (ShowBackground && ShowSprites && bg_color_index && sprite_color_index && pixel_x < 255 && sprite_i == 0)
-            SpriteZeroHit = 1;
+  // Sprites for this line, with priority and sprite-0 bits.
+  memset(sprite_line, 0, sizeof(sprite_line));
+  if (ShowBackground || ShowSprites)
+    evaluate_sprites(pixel_y);
+  if (ShowSprites)
+    render_sprite_line(pixel_y);
+
+  // Hide the leftmost 8 pixels if asked to.
+  if (!ShowBGInLeftMost)
+    memset(bg_line, 0, 8);
+  if (!ShowSpritesInLeftMost)
+    memset(sprite_line, 0, 8);
+
+  // A shadow PPU's status flags are never read; the PPU it replays for raises sprite-0 hit.
+  if (!replaying)
+    sprite_zero_hit_x = find_sprite_zero_hit();
+
+  if (line_palette_dirty)
+    update_line_palette();
+  line_palette.emphasis = MakeIndexedColor(0, PPUMASK >> 5);
+
+  if (!indexed_frame)
+    allocate_frame();
+  mix_line(bg_line, sprite_line, line_palette, &indexed_frame[WIDTH * pixel_y]);
+  rgb_frame_stale = true;
+  finish_lines(pixel_y, 1);
+}
 
-          if (sprite_color_index != 0)
-            break;
-        }
+void PPU::log_scanline()
+{
+  // Drawing samples the pattern table mapping and nametable mirroring at the start of each
+  // line, so changes to them are logged here rather than where the mapper makes them.
+  update_chr_slots();
+  for (int slot = 0; slot < 8; ++slot)
+  {
+    const CHRSlot &current = chr_slots[slot];
+    if (current.cache != logged_chr_slots[slot].cache || current.first_tile != logged_chr_slots[slot].first_tile)
+    {
+      log_event(PPULogEvent::CHRSlot, slot, current.cache == &cart_tiles, current.first_tile);
+      logged_chr_slots[slot] = current;
     }
   }
 
-  // Combine. Assume BG will 'win' and then look at cases where sprite would win instead.
-  u8 output_color_index = master_palette_index_bg;
-  if ((bg_color_index == 0 && sprite_color_index > 0) || (sprite_has_priority && sprite_color_index))
-    output_color_index = master_palette_index_sprite;
+  const MirroringMode mirroring = cart->GetMirroring();
+  if (mirroring != logged_mirroring)
+  {
+    log_event(PPULogEvent::Mirroring, 0, (u8)mirroring);
+    logged_mirroring = mirroring;
+  }
 
-  const auto set_pixel_color = [&](int x, int y, u8 color_index) {
-    u32 pixel_num = WIDTH * y + x;
+  // Lines the accurate backend draws here are not drawn again by the shadow.
+  if (!skipping_frame_output && !loopy_frame)
+    log_event(PPULogEvent::LineStart, pixel_y, 0);
 
-    u8 r = PALETTE_BYTES[3 * color_index + 0];
-    u8 g = PALETTE_BYTES[3 * color_index + 1];
-    u8 b = PALETTE_BYTES[3 * color_index + 2];
+  // Hand the log over a few lines at a time, so the worker stays close behind without
+  // being woken for every line.
+  if ((pixel_y & 7) == 7)
+    replay->Submit(render_log);
+}
 
-    pixels[3 * pixel_num] = r;
-    pixels[3 * pixel_num + 1] = g;
-    pixels[3 * pixel_num + 2] = b;
-  };
+void PPU::evaluate_scanline_flags()
+{
+  update_chr_slots();
+  if (ShowBackground || ShowSprites)
+    evaluate_sprites(pixel_y);
+  sprite_zero_hit_x = find_sprite_zero_hit();
+}
 
-  set_pixel_color(pixel_x, pixel_y, output_color_index);
+void PPU::apply_render_mode()
+{
+  if (render_mode == PPURenderMode::Synchronous || !cart)
+  {
+    replay.reset();
+    return;
+  }
+
+  const bool threaded = render_mode == PPURenderMode::Threaded;
+  if (replay && replay->IsThreaded() == threaded)
+    return;
+
+  // The new shadow starts from the current state, so nothing logged so far is needed.
+  replay.reset();
+  render_log.clear();
+  update_chr_slots();
+  memcpy(logged_chr_slots, chr_slots, sizeof(chr_slots));
+  logged_mirroring = cart->GetMirroring();
+  replay.reset(new PPUReplay(*this, threaded));
+}
+
+void PPU::copy_render_state(PPU &source)
+{
+  replaying = true;
+  cart = source.cart;
+
+  PPUCTRL = source.PPUCTRL;
+  PPUMASK = source.PPUMASK;
+  scroll_x = source.scroll_x;
+  scroll_y = source.scroll_y;
+  memcpy(vram, source.vram, 0x4000);
+  memcpy(OAM_RAM, source.OAM_RAM, 64 * 4);
+  mix_line = source.mix_line;
+
+  vram_tiles.InvalidateAll();
+  line_palette_dirty = true;
+
+  // CHR-RAM keeps changing under the source, so the shadow draws from a copy that it
+  // updates from the log.
+  if (cart->HasCHRRAM())
+  {
+    replay_chr_ram.reset(new u8[cart->GetCHRMemorySize()]);
+    memcpy(replay_chr_ram.get(), cart->GetCHRMemory(), cart->GetCHRMemorySize());
+    attach_cart_tiles(replay_chr_ram.get());
+  }
+  else
+  {
+    attach_cart_tiles(cart->GetCHRMemory());
+  }
+  for (int slot = 0; slot < 8; ++slot)
+  {
+    const CHRSlot &from = source.chr_slots[slot];
+    chr_slots[slot] = {from.cache == &source.cart_tiles ? &cart_tiles : get_vram_tiles(), from.first_tile};
+  }
+  nametable_pages = replay_nametable_pages;
+  set_replay_mirroring(source.cart->GetMirroring());
+}
+
+void PPU::set_replay_mirroring(MirroringMode mode)
+{
+  const u8 *pages = GetMirroringPages(mode);
+  for (int i = 0; i < 4; ++i)
+    replay_nametable_pages[i] = vram + 0x2000 + 0x400 * pages[i];
+}
+
+void PPU::replay_log(const PPULogEvent *events, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    const PPULogEvent &event = events[i];
+    switch (event.kind)
+    {
+    case PPULogEvent::Ctrl:
+      PPUCTRL = event.value;
+      break;
+    case PPULogEvent::Mask:
+      if ((PPUMASK ^ event.value) & 1)
+        line_palette_dirty = true;
+      PPUMASK = event.value;
+      break;
+    case PPULogEvent::ScrollX:
+      scroll_x = event.value;
+      break;
+    case PPULogEvent::ScrollY:
+      scroll_y = event.value;
+      break;
+    case PPULogEvent::VRAMWrite:
+      write_vram(event.addr, event.value);
+      break;
+    case PPULogEvent::CHRWrite:
+      replay_chr_ram[event.data] = event.value;
+      note_chr_tile_write(event.data >> 4);
+      break;
+    case PPULogEvent::OAMWrite:
+      OAM_RAM[event.addr & 0xFF] = event.value;
+      break;
+    case PPULogEvent::CHRSlot:
+      chr_slots[event.addr & 7] = {event.value ? &cart_tiles : get_vram_tiles(), event.data};
+      break;
+    case PPULogEvent::Mirroring:
+      set_replay_mirroring((MirroringMode)event.value);
+      break;
+    case PPULogEvent::LineStart:
+      pixel_y = event.addr;
+      render_scanline();
+      break;
+    default:
+      // $2006 writes only matter through the $2007 addresses they set up, which are
+      // logged already resolved.
+      break;
+    }
+  }
 }
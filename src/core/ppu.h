@@ -1,13 +1,35 @@
 #pragma once
 
+#include <cstring>
 #include <memory>
 #include <functional>
+#include <vector>
 #include "core/types.h"
 #include "core/texture.h"
+#include "core/cartridge.h"
+#include "core/palette.h"
 #include "core/state.h"
+#include "core/tile_cache.h"
+#include "core/pixel_kernels.h"
+#include "core/ppu_replay.h"
 
 class Bus;
-class Cartridge;
+
+// Which renderer draws the visible lines.
+//  - Fast: a whole line at a time at its first dot, from the scroll registers.
+//  - Accurate: a dot at a time, modelling the hardware's v/t/x/w registers, background
+//    shift registers and fetch schedule, so writes in the middle of a line (or $2006
+//    scrolling) land on the right pixel.
+//  - Auto: Fast, switching to Accurate for a while after the game changes the scroll in
+//    the middle of the picture.
+// Both share all register and memory state, so the choice can change every frame.
+enum class PPUBackend
+{
+  Fast,
+  Accurate,
+  Auto,
+};
+
 class PPU
 {
 private:
@@ -21,7 +43,10 @@ private:
   u8 scroll_x;
   u8 scroll_y;
 
+  // The hardware's "loopy" registers: vram_addr is v and address_latch is w.
   u16 vram_addr;
+  u16 temp_vram_addr; // t
+  u8 fine_x_scroll;   // x
 
   u8 PPU_DATA_read_buffer;
 
@@ -74,16 +99,270 @@ private:
   u8 *vram;
   u8 *OAM_RAM;
 
+  // Output of the PPU: 256x240 indexed colors (see core/palette.h), and an RGB copy that
+  // is converted on request. The indexed frame is allocated when the first line is drawn,
+  // so consoles that have not run yet do not touch it; until then the picture is blank.
+  std::unique_ptr<u16[]> indexed_frame;
   Texture frame_buffer;
+  bool rgb_frame_stale;
+
+  // The caller's buffer the picture is also written to, if any (see SetFrameOutput()).
+  u8 *frame_output;
+  int frame_output_pitch;
+  PixelFormat frame_output_format;
+
+  // Content hashes: each line's as it is finished, and what the frame ended up with as of
+  // the last frame end, along with the lines that changed in that frame.
+  HashLineFn hash_line;
+  u64 line_hashes[240];
+  u64 frame_line_hashes[240];
+  u64 dirty_lines[4];
+  int dirty_line_count;
+  u64 frame_hash;
+
+  // Lines of indexed_frame that are done: hash them and copy them to the frame output.
+  void finish_lines(int first_line, int count);
+  void allocate_frame();
+  void publish_frame_hashes();
+
   Texture pattern_left;
   Texture pattern_right;
   Texture nametables;
+  bool debug_textures_allocated;
   std::shared_ptr<Cartridge> cart;
 
-  void render_pixel();
+  void allocate_debug_textures();
+
+  // What has changed since a debug view was last brought up to date. Tracked only once the
+  // debug textures exist, so that the views can be refreshed on request by redrawing just
+  // the tiles that changed.
+  struct DebugViewChanges
+  {
+    bool all;
+    u8 tiles[512];              // Pattern tiles, by pattern table address >> 4
+    u8 nametable_bytes[0x1000]; // Nametable RAM, by mirrored address - $2000
+
+    // Inputs that affect the whole view, as of the last refresh
+    const Cartridge *cart;
+    u32 chr_serial;
+    MirroringMode mirroring;
+    bool bg_pattern_table;
+
+    // Where the scroll window outline was drawn in the nametable view
+    bool window_drawn;
+    int window_x, window_y;
+
+    void Clear()
+    {
+      all = false;
+      memset(tiles, 0, sizeof(tiles));
+      memset(nametable_bytes, 0, sizeof(nametable_bytes));
+    }
+
+    void Reset()
+    {
+      Clear();
+      all = true;
+      cart = nullptr;
+      window_drawn = false;
+    }
+  };
+  DebugViewChanges pattern_view_changes;
+  DebugViewChanges nametable_view_changes;
+
+  void check_debug_view_inputs(DebugViewChanges &changes);
+  void note_debug_view_write(u16 addr);
+
+  // Decoded pattern tiles: one cache over the cartridge's CHR-ROM (shared with its
+  // RomImage) or CHR-RAM, keyed by physical offset, and one over the PPU-side pattern
+  // memory that is used where the cartridge maps nothing.
+  TileCache cart_tiles;
+  TileCache vram_tiles;
+
+  // Where each 1KB of the pattern tables ($0000-$1FFF) currently points, refreshed when the
+  // cartridge reports a CHR bank switch.
+  struct CHRSlot
+  {
+    TileCache *cache;
+    u32 first_tile;
+  };
+  CHRSlot chr_slots[8];
+  const Cartridge *chr_slots_cart;
+  u32 chr_slots_serial;
+
+  void update_chr_slots();
+  void attach_cart_tiles(const u8 *chr);
+  TileCache *get_vram_tiles();
+  void take_chr_writes();
+  void note_chr_tile_write(u32 tile);
+
+  // Row (addr & 7) of the tile at pattern table address 'addr', as 8 color indices.
+  const u8 *tile_row(u16 addr, bool flip_horizontal)
+  {
+    const CHRSlot &slot = chr_slots[(addr >> 10) & 7];
+    return slot.cache->Row(slot.first_tile + ((addr & 0x3FF) >> 4), addr & 7, flip_horizontal);
+  }
+
+  // Up to 8 sprites selected for the current line, in OAM order.
+  u8 secondary_OAM[8 * 4];
+  u8 secondary_oam_count;
+  bool sprite_zero_in_secondary_oam;
+
+  // Per-line sprite buffer: bits 0-3 palette index within the sprite palettes, bit 4 set
+  // for any sprite pixel (so the low 5 bits index the full 32-entry palette), plus:
+  static const u8 SPRITE_BEHIND_BG = LINE_MIX_SPRITE_BEHIND_BG;
+  static const u8 SPRITE_ZERO = 0x40;
+  u8 sprite_line[256];
+
+  // Dot on the current line where sprite-0 hit will be raised, or -1.
+  i16 sprite_zero_hit_x;
+
+  // Final background/sprite mix, picked for the CPU at startup.
+  MixLineFn mix_line;
+
+  // RGB palette used by mix_line, rebuilt only after palette RAM changes.
+  LinePalette line_palette;
+  bool line_palette_dirty;
+  void update_line_palette();
+
+  void render_scanline();
+  void evaluate_sprites(int line);
+  void render_sprite_line(int line);
+
+  // Background pixels (palette << 2 | color) of the tile at 'nametable_x' (0-511), for
+  // 'rows' lines from nametable line 'nametable_y' (0-479) down, within that tile. Both
+  // coordinates count across all four nametables.
+  void fetch_background_tile(int nametable_x, int nametable_y, u8 *out, int rows = 1, int out_stride = 0);
+
+  // The background of all four nametables (512x480, palette << 2 | color), kept up to date
+  // one 8x8 cell at a time: writes only mark cells dirty, and dirty cells are redrawn when a
+  // line (or the nametable view) needs them. Allocated on first use.
+  std::unique_ptr<u8[]> background_layer;
+  u64 background_dirty[60]; // One bit per cell, by cell row
+
+  // Pattern tiles written in PPU memory since the layer was last brought up to date.
+  bool background_tiles_written;
+  u8 background_written_tiles[512];
+
+  // What the layer was drawn with; a change to any of these redraws all of it.
+  bool background_table;
+  CHRSlot background_slots[4];
+  u8 *background_pages[4];
+
+  void mark_background_dirty() { memset(background_dirty, 0xFF, sizeof(background_dirty)); }
+  void note_background_write(u16 mirrored_addr);
+  void update_background_layer();
+  void clean_background_cells(int cell_y, int first_cell, int last_cell);
+
+  // Row of 'sprite' (4 bytes of OAM) on 'line', which it must cover.
+  const u8 *sprite_row(const u8 *sprite, int line);
+
+  // Dot on the current line where sprite 0 hits the background, or -1. Works from the
+  // nametables and OAM rather than the line buffers, so it also runs when lines are drawn
+  // elsewhere (see PPURenderMode).
+  i16 find_sprite_zero_hit();
+
+  void write_vram(u16 mirrored_addr, u8 val);
+
+  // Sprite evaluation and sprite-0 hit for the current line, which is all a line needs
+  // when it is not drawn here.
+  void evaluate_scanline_flags();
+
+  // Accurate backend (see PPUBackend). 'loopy_frame' is picked at the end of each frame
+  // for the next one, and Auto keeps it set for AUTO_ACCURATE_FRAMES after the last write
+  // that moved the scroll in the middle of the picture.
+  static const int AUTO_ACCURATE_FRAMES = 120;
+  PPUBackend backend;
+  bool loopy_frame;
+  int auto_accurate_frames;
+  bool odd_frame;
+
+  // Background fetch latches, and the shift registers the pixels come out of.
+  u8 next_tile_id;
+  u8 next_tile_attribute;
+  u8 next_tile_lsb;
+  u8 next_tile_msb;
+  u16 pattern_shift_lo, pattern_shift_hi;
+  u16 attribute_shift_lo, attribute_shift_hi;
+
+  bool rendering_enabled() const { return ShowBackground || ShowSprites; }
+  void note_mid_frame_scroll();
+  void increment_vram_addr();
+  void clock_loopy();
+  void load_background_shifters();
+  void increment_scroll_x();
+  void increment_scroll_y();
+  void output_loopy_pixel(int x);
+
+  // Frames without pixel output (see SetSkipFrameOutput()). Latched at the start of each
+  // frame, so a frame is either drawn completely or not at all.
+  bool skip_frame_output;
+  bool skipping_frame_output;
+
+  // Deferred and threaded rendering. While 'replay' exists visible lines are not drawn
+  // here; everything drawing depends on is logged to 'render_log' instead, and replayed
+  // on a second PPU (the "shadow") that draws the frame. The mode only changes between
+  // frames, when the shadow has caught up.
+  PPURenderMode render_mode;
+  std::unique_ptr<PPUReplay> replay;
+  std::vector<PPULogEvent> render_log;
+
+  // What the log last said about state that is sampled rather than written through
+  // registers: the pattern table slots and nametable mirroring.
+  CHRSlot logged_chr_slots[8];
+  MirroringMode logged_mirroring;
+
+  void log_event(PPULogEvent::Kind kind, u16 addr, u8 value, u32 data = 0)
+  {
+    render_log.push_back({kind, value, addr, 341u * pixel_y + pixel_x, data});
+  }
+
+  void log_scanline();
+  void apply_render_mode();
+
+  // Scanline counter (see Cartridge::HasScanlineCounter()): the frame position
+  // (341 * line + dot) its clocks have been handed over up to, and the position of the
+  // clock that raises its next IRQ, or NO_SCANLINE_IRQ. Run() only compares against the
+  // latter, so the counter costs nothing between register writes and IRQs.
+  static const u32 NO_SCANLINE_IRQ = 0xFFFFFFFF;
+  bool scanline_counter;
+  u32 scanline_counter_synced;
+  u32 scanline_irq_position;
+
+  u32 frame_position() const;
+
+  // The dot of each rendered line that clocks the counter, or -1 if none does.
+  int scanline_counter_dot() const;
+
+  // Per-dot and per-line work, driven by the timing table (see core/ppu_timing.h).
+  void check_nmi();
+  void run_dot_actions(u8 actions);
+  void start_line();
+
+  // Shadow side: take over the source PPU's drawing state, then draw from its log.
+  friend class PPUReplay;
+  bool replaying;
+  u8 *replay_nametable_pages[4];
+  std::unique_ptr<u8[]> replay_chr_ram;
+  void copy_render_state(PPU &source);
+  void set_replay_mirroring(MirroringMode mode);
+  void replay_log(const PPULogEvent *events, size_t count);
   void render_pattern_tables();
   void render_nametables();
 
+  void refresh_pattern_tables()
+  {
+    if (!debug_textures_allocated)
+      allocate_debug_textures();
+    if (cart)
+      render_pattern_tables();
+  }
+
+  // The cartridge's nametable page table (or a shadow PPU's own): nametable
+  // (addr >> 10) & 3 starts at nametable_pages[...] in 'vram'.
+  u8 *const *nametable_pages;
+
+  // Offset in 'vram' that PPU address 'addr' lands on.
   u16 NametableMirroring(u16 addr);
   u8 ppuRead(u16 addr);
 
@@ -92,26 +371,112 @@ public:
   ~PPU();
 
   void SetBus(std::shared_ptr<Bus> bus) { this->bus = bus; }
-  void SetCartridge(std::shared_ptr<Cartridge> &cart) { this->cart = cart; }
+  void SetCartridge(std::shared_ptr<Cartridge> &cart);
+
+  // Takes effect at the end of the current frame.
+  void SetRenderMode(PPURenderMode mode) { render_mode = mode; }
+  PPURenderMode GetRenderMode() const { return render_mode; }
+
+  // Takes effect at the start of the next frame.
+  void SetBackend(PPUBackend backend) { this->backend = backend; }
+  PPUBackend GetBackend() const { return backend; }
+
+  // Whether the frame being drawn uses the accurate backend.
+  bool IsAccurateFrame() const { return loopy_frame; }
+
+  // Skip drawing from the next frame on, e.g. for fast-forward. Status flags (VBlank,
+  // sprite-0 hit, sprite overflow) and all other state stay exact; the frame buffers keep
+  // the last frame that was drawn.
+  void SetSkipFrameOutput(bool skip) { skip_frame_output = skip; }
+  bool GetSkipFrameOutput() const { return skip_frame_output; }
 
   u8 Read(u16 addr);
   void Write(u16 addr, u8 val);
 
+  // Hand the cartridge's scanline counter the clocks it has had up to now. Call before
+  // anything that reads or changes its state, e.g. writes to its registers.
+  void SyncScanlineCounter();
+
+  // Pass the counter's IRQ on to the CPU, and work out when its next one is due. Call
+  // after its registers have changed.
+  void ScheduleScanlineIRQ();
+
+  // Register read without side effects (no latch resets or read buffer updates).
+  u8 Peek(u16 addr) const;
+
   // Advance by one clock cycle (1/3 of a CPU cycle, 1 pixel)
   void Clock();
 
-  Texture &GetFrameBufferTexture() { return frame_buffer; }
-  Texture &GetPatternTableLeftTexture() { return pattern_left; }
-  Texture &GetPatternTableRightTexture() { return pattern_right; }
-  Texture &GetNametablesTexture() { return nametables; }
+  // Advance by 'dots' clock cycles, skipping over stretches where nothing happens.
+  void Run(int dots);
+
+  // The current picture as 256x240 indexed colors: NES color in bits 0-5, emphasis in
+  // bits 6-8. Updated a line at a time as the frame is drawn, or (in the deferred and
+  // threaded render modes) once the whole frame is finished.
+  const u16 *GetIndexedFrameBuffer() const;
+
+  // The current picture as RGB, converted from the indexed frame if it has changed.
+  Texture &GetFrameBufferTexture();
+
+  // Content hashes of the last finished frame: one per line, and one over all of them.
+  // Lines whose hash differs from the frame before are dirty; a frame that was not drawn
+  // (see SetSkipFrameOutput()) has none. Useful for skipping uploads, encoding or
+  // duplicate observations.
+  u64 GetFrameHash() const { return frame_hash; }
+  u64 GetLineHash(int line) const { return frame_line_hashes[line]; }
+  bool IsLineDirty(int line) const { return (dirty_lines[line >> 6] >> (line & 63)) & 1; }
+  int GetDirtyLineCount() const { return dirty_line_count; }
+
+  // Also write the picture straight into 'pixels': 256x240 in 'format', rows 'pitch' bytes
+  // apart. Lines are written as they are finished (in the deferred and threaded render
+  // modes, when the frame is), and the current picture right away. The buffer has to stay
+  // valid until it is replaced, or removed by passing nullptr.
+  void SetFrameOutput(void *pixels, int pitch, PixelFormat format);
+
+  // Debug views. Their textures are allocated on first use, and brought up to date
+  // (redrawing only what changed since the last call) each time they are requested.
+  Texture &GetPatternTableLeftTexture()
+  {
+    refresh_pattern_tables();
+    return pattern_left;
+  }
+
+  Texture &GetPatternTableRightTexture()
+  {
+    refresh_pattern_tables();
+    return pattern_right;
+  }
+
+  Texture &GetNametablesTexture()
+  {
+    if (!debug_textures_allocated)
+      allocate_debug_textures();
+    if (cart)
+      render_nametables();
+    return nametables;
+  }
 
   void GetState(PPURegisterState *state);
+  u16 GetScanline() const { return pixel_y; }
+  u16 GetDot() const { return pixel_x; }
 
   u8 *GetVRAM()
   {
     return vram;
   }
 
+  // Call after modifying memory through GetVRAM().
+  void InvalidateVRAMCaches()
+  {
+    vram_tiles.InvalidateAll();
+    line_palette_dirty = true;
+    pattern_view_changes.all = true;
+    nametable_view_changes.all = true;
+
+    // The shadow PPU (if any) has not seen the change; start a new one next frame.
+    replay.reset();
+  }
+
   u8 *GetOAMRAM()
   {
     return OAM_RAM;
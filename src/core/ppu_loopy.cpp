@@ -0,0 +1,185 @@
+#include "./ppu.h"
+#include "core/cartridge.h"
+#include "core/palette.h"
+#include <cstring>
+
+// The accurate backend (PPUBackend::Accurate): the background is fetched and shifted out
+// a dot at a time, following the hardware's schedule, with the scroll position living in
+// v (vram_addr) as it does on the real thing. Register writes therefore take effect on the
+// exact dot they land on. Sprites are still evaluated a line at a time, at dot 257 of the
+// line before, into the same sprite line buffer the fast renderer uses.
+//
+// v and t are laid out as yyy NN YYYYY XXXXX: fine Y, nametable, coarse Y, coarse X.
+
+static const int WIDTH = 256;
+static const int HEIGHT = 240;
+static const int PRE_RENDER_SCANLINE = 261;
+
+void PPU::clock_loopy()
+{
+  const int dot = pixel_x;
+
+  if (rendering_enabled())
+  {
+    // Each tile takes 8 dots: nametable byte, attribute byte, then the two pattern bytes,
+    // after which coarse X moves on. Dots 321-336 fetch the first two tiles of the next line.
+    if ((dot >= 2 && dot <= 257) || (dot >= 322 && dot <= 337))
+    {
+      pattern_shift_lo <<= 1;
+      pattern_shift_hi <<= 1;
+      attribute_shift_lo <<= 1;
+      attribute_shift_hi <<= 1;
+    }
+
+    if ((dot >= 2 && dot <= 257) || (dot >= 321 && dot <= 337))
+    {
+      switch ((dot - 1) & 7)
+      {
+      case 0:
+        load_background_shifters();
+        next_tile_id = ppuRead(0x2000 | (vram_addr & 0x0FFF));
+        break;
+      case 2:
+      {
+        u8 attribute = ppuRead(0x23C0 | (vram_addr & 0x0C00) | ((vram_addr >> 4) & 0x38) | ((vram_addr >> 2) & 0x07));
+        if (vram_addr & 0x40) // Bottom half of the 32x32 attribute area
+          attribute >>= 4;
+        if (vram_addr & 0x02) // Right half
+          attribute >>= 2;
+        next_tile_attribute = attribute & 3;
+        break;
+      }
+      case 4:
+      case 6:
+      {
+        const u16 pattern_addr = (BGPatternTableAddress ? 0x1000 : 0x0000) | (next_tile_id << 4) | ((vram_addr >> 12) & 7);
+        if (((dot - 1) & 7) == 4)
+          next_tile_lsb = ppuRead(pattern_addr);
+        else
+          next_tile_msb = ppuRead(pattern_addr + 8);
+        break;
+      }
+      case 7:
+        increment_scroll_x();
+        break;
+      }
+    }
+
+    if (dot == 256)
+      increment_scroll_y();
+
+    // Back to the left edge for the next line
+    if (dot == 257)
+      vram_addr = (vram_addr & ~0x041F) | (temp_vram_addr & 0x041F);
+
+    // Unused nametable fetches at the end of the line
+    if (dot == 338 || dot == 340)
+      next_tile_id = ppuRead(0x2000 | (vram_addr & 0x0FFF));
+
+    // And back to the top for the next frame
+    if (pixel_y == PRE_RENDER_SCANLINE && dot >= 280 && dot <= 304)
+      vram_addr = (vram_addr & ~0x7BE0) | (temp_vram_addr & 0x7BE0);
+  }
+
+  // Sprites for the next line, picked while this one finishes.
+  if (dot == 257)
+  {
+    const int next_line = pixel_y == PRE_RENDER_SCANLINE ? 0 : pixel_y + 1;
+    memset(sprite_line, 0, sizeof(sprite_line));
+    secondary_oam_count = 0;
+    sprite_zero_in_secondary_oam = false;
+
+    if (next_line < HEIGHT && rendering_enabled())
+    {
+      update_chr_slots();
+      evaluate_sprites(next_line);
+      render_sprite_line(next_line);
+    }
+  }
+
+  if (pixel_y < HEIGHT && dot >= 1 && dot <= WIDTH)
+  {
+    output_loopy_pixel(dot - 1);
+    if (dot == WIDTH && !skipping_frame_output)
+      finish_lines(pixel_y, 1);
+  }
+}
+
+void PPU::load_background_shifters()
+{
+  pattern_shift_lo = (pattern_shift_lo & 0xFF00) | next_tile_lsb;
+  pattern_shift_hi = (pattern_shift_hi & 0xFF00) | next_tile_msb;
+  attribute_shift_lo = (attribute_shift_lo & 0xFF00) | ((next_tile_attribute & 1) ? 0xFF : 0x00);
+  attribute_shift_hi = (attribute_shift_hi & 0xFF00) | ((next_tile_attribute & 2) ? 0xFF : 0x00);
+}
+
+void PPU::increment_scroll_x()
+{
+  // Past the right edge of a nametable, into the one next to it
+  if ((vram_addr & 0x001F) == 31)
+  {
+    vram_addr &= ~0x001F;
+    vram_addr ^= 0x0400;
+  }
+  else
+  {
+    vram_addr++;
+  }
+}
+
+void PPU::increment_scroll_y()
+{
+  if ((vram_addr & 0x7000) != 0x7000)
+  {
+    vram_addr += 0x1000; // Next fine Y
+    return;
+  }
+
+  vram_addr &= ~0x7000;
+  int coarse_y = (vram_addr & 0x03E0) >> 5;
+  if (coarse_y == 29)
+  {
+    // Past the bottom row of tiles, into the nametable below
+    coarse_y = 0;
+    vram_addr ^= 0x0800;
+  }
+  else if (coarse_y == 31)
+  {
+    // Rows 30 and 31 are the attribute table; scrolling into them wraps without switching
+    coarse_y = 0;
+  }
+  else
+  {
+    coarse_y++;
+  }
+  vram_addr = (vram_addr & ~0x03E0) | (coarse_y << 5);
+}
+
+void PPU::output_loopy_pixel(int x)
+{
+  u8 bg = 0;
+  if (ShowBackground && (x >= 8 || ShowBGInLeftMost))
+  {
+    const u16 bit = 0x8000 >> fine_x_scroll;
+    const u8 color = ((pattern_shift_hi & bit) ? 2 : 0) | ((pattern_shift_lo & bit) ? 1 : 0);
+    const u8 palette = ((attribute_shift_hi & bit) ? 2 : 0) | ((attribute_shift_lo & bit) ? 1 : 0);
+    if (color)
+      bg = (palette << 2) | color;
+  }
+
+  u8 sprite = 0;
+  if (ShowSprites && (x >= 8 || ShowSpritesInLeftMost))
+    sprite = sprite_line[x];
+
+  // Never on the last pixel of the line
+  if ((sprite & SPRITE_ZERO) && (sprite & 3) && bg && x < WIDTH - 1)
+    SpriteZeroHit = 1;
+
+  if (skipping_frame_output)
+    return;
+
+  if (line_palette_dirty)
+    update_line_palette();
+  indexed_frame[WIDTH * pixel_y + x] = line_palette.colors[MixLinePixel(bg, sprite)] | MakeIndexedColor(0, PPUMASK >> 5);
+  rgb_frame_stale = true;
+}
@@ -0,0 +1,106 @@
+#include "core/ppu_replay.h"
+#include "core/ppu.h"
+
+PPUReplay::PPUReplay(PPU &source, bool threaded)
+    : shadow(new PPU()),
+      threaded(threaded),
+      worker_busy(false),
+      stopping(false)
+{
+  shadow->copy_render_state(source);
+
+  if (threaded)
+    worker = std::thread([this]() { run_worker(); });
+}
+
+PPUReplay::~PPUReplay()
+{
+  if (threaded)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    work_available.notify_one();
+    worker.join();
+  }
+}
+
+void PPUReplay::Submit(std::vector<PPULogEvent> &events)
+{
+  if (events.empty())
+    return;
+
+  if (threaded)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.insert(pending.end(), events.begin(), events.end());
+    }
+    work_available.notify_one();
+  }
+  else
+  {
+    pending.insert(pending.end(), events.begin(), events.end());
+  }
+
+  events.clear();
+}
+
+void PPUReplay::CatchUp(std::vector<PPULogEvent> &events)
+{
+  Submit(events);
+
+  if (!threaded)
+  {
+    shadow->replay_log(pending.data(), pending.size());
+    pending.clear();
+  }
+}
+
+void PPUReplay::FinishFrame(std::vector<PPULogEvent> &events, std::unique_ptr<u16[]> &frame)
+{
+  Submit(events);
+
+  if (threaded)
+  {
+    // Once the worker has drained the log it is idle until the next Submit(), so the
+    // frame buffers can be swapped without it noticing.
+    std::unique_lock<std::mutex> lock(mutex);
+    work_finished.wait(lock, [this]() { return pending.empty() && !worker_busy; });
+  }
+  else
+  {
+    shadow->replay_log(pending.data(), pending.size());
+    pending.clear();
+  }
+
+  std::swap(frame, shadow->indexed_frame);
+}
+
+void PPUReplay::run_worker()
+{
+  std::vector<PPULogEvent> batch;
+
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      work_available.wait(lock, [this]() { return stopping || !pending.empty(); });
+      if (pending.empty())
+        return; // Stopping, with nothing left to draw
+
+      batch.swap(pending);
+      worker_busy = true;
+    }
+
+    shadow->replay_log(batch.data(), batch.size());
+    batch.clear();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      worker_busy = false;
+    }
+    work_finished.notify_one();
+  }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "core/types.h"
+
+class PPU;
+
+// How the PPU produces its picture.
+//  - Synchronous: each visible line is drawn as the PPU reaches it.
+//  - Deferred: everything drawing depends on is logged as the frame runs, and the log is
+//    replayed into the picture at the end of the frame.
+//  - Threaded: as Deferred, but the log is replayed on a worker thread a few lines behind
+//    the emulation, so pixel generation overlaps with CPU emulation.
+// All three produce identical frames.
+enum class PPURenderMode
+{
+  Synchronous,
+  Deferred,
+  Threaded,
+};
+
+// One entry in the PPU's render log. 'dot' is when it happened: scanline * 341 + dot.
+struct PPULogEvent
+{
+  enum Kind : u8
+  {
+    Ctrl,      // $2000 write: value
+    Mask,      // $2001 write: value
+    ScrollX,   // $2005 first write: value
+    ScrollY,   // $2005 second write: value
+    Address,   // $2006 write: value, addr = which half (0 high, 1 low)
+    VRAMWrite, // $2007 write: value, addr = mirrored VRAM address written
+    CHRWrite,  // $2007 write to CHR-RAM: value, data = offset in CHR-RAM
+    OAMWrite,  // $2004 write or OAM DMA byte: value, addr = OAM address
+    CHRSlot,   // Pattern table 1KB slot 'addr' remapped: value = 1 for cartridge CHR memory, data = first tile
+    Mirroring, // Nametable mirroring changed: value = MirroringMode
+    LineStart, // Draw visible line 'addr' with the state as of now
+    FrameEnd,
+  };
+
+  Kind kind;
+  u8 value;
+  u16 addr;
+  u32 dot;
+  u32 data;
+};
+
+// Replays a PPU's render log on a second PPU (see PPU::replay_log()) and hands back the
+// finished frames.
+class PPUReplay
+{
+private:
+  std::unique_ptr<PPU> shadow;
+  const bool threaded;
+
+  // Events submitted but not yet replayed.
+  std::vector<PPULogEvent> pending;
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable work_finished;
+  bool worker_busy;
+  bool stopping;
+
+  void run_worker();
+
+public:
+  // Starts from a copy of everything in 'source' that drawing depends on.
+  PPUReplay(PPU &source, bool threaded);
+  ~PPUReplay();
+
+  bool IsThreaded() const { return threaded; }
+
+  // Hand over the events logged so far, and clear 'events'. The worker thread (if any)
+  // starts on them right away.
+  void Submit(std::vector<PPULogEvent> &events);
+
+  // Submit 'events' at the end of a frame nobody waits for (skipped, or drawn by the
+  // accurate backend). Without a worker they are replayed now, since no FinishFrame() is
+  // coming to do it and the log would otherwise grow for as long as such frames last.
+  void CatchUp(std::vector<PPULogEvent> &events);
+
+  // Submit 'events', wait until everything has been replayed, and swap the finished frame
+  // into 'frame'. The shadow PPU draws the next frame into the buffer it gets back.
+  void FinishFrame(std::vector<PPULogEvent> &events, std::unique_ptr<u16[]> &frame);
+};
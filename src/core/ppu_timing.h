@@ -0,0 +1,134 @@
+#pragma once
+
+#include "core/types.h"
+
+// What the PPU has to do on each of the 341x262 dots of a frame, worked out once at compile
+// time. Most dots have nothing to do (outside of the accurate backend's fetches), so each
+// line is stored as a few spans of identical dots and the PPU skips idle spans in one step.
+
+static const int PPU_DOTS_PER_LINE = 341;
+static const int PPU_LINES_PER_FRAME = 262;
+
+static const int PPU_VISIBLE_LINES = 240;
+static const int PPU_FIRST_VBLANK_LINE = 241;
+static const int PPU_PRE_RENDER_LINE = 261;
+
+// Scanline counters (see Cartridge::ClockScanlineCounter()) are clocked by pattern table
+// address line A12 rising, which only happens when the background and sprites use
+// different tables: once per rendered line, a few dots into the sprite fetches if those
+// come from $1000, or into the next line's background fetches if those do.
+static const int PPU_A12_SPRITE_FETCH_DOT = 260;
+static const int PPU_A12_BACKGROUND_FETCH_DOT = 324;
+
+// How many of those clocks, at 'dot' of each rendered line, a frame has before 'position'
+// (341 * line + dot).
+constexpr u32 CountScanlineClocksBefore(u32 position, int dot)
+{
+  if (position <= (u32)dot)
+    return 0;
+
+  // Lines up to the one 'position' is on, whose clock has been passed; of those, the
+  // visible lines and the pre-render line are rendered.
+  const u32 lines = (position - dot - 1) / PPU_DOTS_PER_LINE + 1;
+  return (lines < PPU_VISIBLE_LINES ? lines : PPU_VISIBLE_LINES) + (lines > PPU_PRE_RENDER_LINE ? 1 : 0);
+}
+
+// Work done at the start of a dot
+enum PPUDotAction : u8
+{
+  DOT_LINE_START = 1 << 0,      // Draw (or log, or evaluate) a visible line
+  DOT_VBLANK_SET = 1 << 1,      // VBlank flag on, NMI if enabled
+  DOT_VBLANK_CLEAR = 1 << 2,    // VBlank, sprite-0 hit and overflow off
+  DOT_ODD_FRAME_SKIP = 1 << 3,  // Afterwards, skip the next dot on odd frames (accurate backend)
+};
+
+// Work done on entering a line
+enum PPULineAction : u8
+{
+  LINE_RENDERED = 1 << 0,    // Visible or pre-render: the accurate backend clocks every dot
+  LINE_FRAME_START = 1 << 1, // Latch per-frame settings
+  LINE_FRAME_END = 1 << 2,   // Finish the picture and pick the next frame's backend
+  LINE_DEBUG_PRINT = 1 << 3, // Log sprite 0 and the scroll (debug level)
+};
+
+// 'length' dots from 'dot' on, all with the same actions.
+struct PPUDotSpan
+{
+  u16 dot = 0;
+  u16 length = 0;
+  u8 actions = 0;
+};
+
+constexpr u8 GetPPUDotActions(int line, int dot)
+{
+  u8 actions = 0;
+  if (line < PPU_VISIBLE_LINES && dot == 0)
+    actions |= DOT_LINE_START;
+  if (line == PPU_FIRST_VBLANK_LINE && dot == 1)
+    actions |= DOT_VBLANK_SET;
+  if (line == PPU_PRE_RENDER_LINE && dot == 1)
+    actions |= DOT_VBLANK_CLEAR;
+  if (line == PPU_PRE_RENDER_LINE && dot == 339)
+    actions |= DOT_ODD_FRAME_SKIP;
+  return actions;
+}
+
+constexpr u8 GetPPULineActions(int line)
+{
+  u8 actions = 0;
+  if (line < PPU_VISIBLE_LINES || line == PPU_PRE_RENDER_LINE)
+    actions |= LINE_RENDERED;
+  if (line == 0)
+    actions |= LINE_FRAME_START;
+  if (line == PPU_PRE_RENDER_LINE)
+    actions |= LINE_FRAME_END;
+  if (line == 33)
+    actions |= LINE_DEBUG_PRINT;
+  return actions;
+}
+
+struct PPUTimingTable
+{
+  // Enough for every line; checked below.
+  static const int MAX_SPANS = 4 * PPU_LINES_PER_FRAME;
+
+  PPUDotSpan spans[MAX_SPANS];
+  u16 line_first_span[PPU_LINES_PER_FRAME];
+  u8 line_actions[PPU_LINES_PER_FRAME];
+  int span_count;
+
+  // Run-length encodes GetPPUDotActions() line by line, so spans never cross a line end.
+  // Dots with actions always get a span of their own, as actions run once per span.
+  constexpr PPUTimingTable() : spans(), line_first_span(), line_actions(), span_count(0)
+  {
+    for (int line = 0; line < PPU_LINES_PER_FRAME; ++line)
+    {
+      line_first_span[line] = span_count;
+      line_actions[line] = GetPPULineActions(line);
+
+      for (int dot = 0; dot < PPU_DOTS_PER_LINE;)
+      {
+        const u8 actions = GetPPUDotActions(line, dot);
+        int length = 1;
+        while (!actions && dot + length < PPU_DOTS_PER_LINE && !GetPPUDotActions(line, dot + length))
+          length++;
+
+        spans[span_count] = {(u16)dot, (u16)length, actions};
+        span_count++;
+        dot += length;
+      }
+    }
+  }
+
+  // The span 'dot' of 'line' falls in
+  const PPUDotSpan &Find(int line, int dot) const
+  {
+    const PPUDotSpan *span = &spans[line_first_span[line]];
+    while (span->dot + span->length <= dot)
+      span++;
+    return *span;
+  }
+};
+
+static constexpr PPUTimingTable PPU_TIMING{};
+static_assert(PPU_TIMING.span_count <= PPUTimingTable::MAX_SPANS, "PPU timing table overflow");
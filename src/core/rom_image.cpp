@@ -0,0 +1,152 @@
+#include "core/rom_image.h"
+#include <mutex>
+#include <sys/stat.h>
+#include <unordered_map>
+#include "core/mapped_file.h"
+
+namespace
+{
+
+// A loaded file, and what it looked like when it was loaded.
+struct LoadedImage
+{
+  std::weak_ptr<const RomImage> image;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec modified;
+
+  // Held while the file is loaded, so consoles starting together load it once between
+  // them without holding up loads of other files.
+  std::shared_ptr<std::mutex> loading;
+};
+
+// Entries go when their image does (see forget_image()). The mutex only guards the map; no
+// shared_ptr to an image is ever released while holding it, as that could take the image,
+// and so forget_image(), with it.
+struct ImageCache
+{
+  std::mutex mutex;
+  std::unordered_map<std::string, LoadedImage> images;
+};
+
+ImageCache &image_cache()
+{
+  static ImageCache instance;
+  return instance;
+}
+
+struct timespec modified_time(const struct stat &info)
+{
+#ifdef __APPLE__
+  return info.st_mtimespec;
+#else
+  return info.st_mtim;
+#endif
+}
+
+bool same_file(const LoadedImage &loaded, const struct stat &info)
+{
+  const struct timespec modified = modified_time(info);
+  return loaded.device == info.st_dev && loaded.inode == info.st_ino && loaded.size == info.st_size &&
+         loaded.modified.tv_sec == modified.tv_sec && loaded.modified.tv_nsec == modified.tv_nsec;
+}
+
+// The deleter of images: drops the entry for the image's file, unless it has been loaded
+// again since.
+void forget_image(RomImage *image)
+{
+  if (!image->GetPath().empty())
+  {
+    ImageCache &cache = image_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto found = cache.images.find(image->GetPath());
+    if (found != cache.images.end() && found->second.image.expired())
+      cache.images.erase(found);
+  }
+  delete image;
+}
+
+} // namespace
+
+RomLoadError RomImage::create(std::shared_ptr<const u8> data, size_t size, const char *path, std::shared_ptr<const RomImage> &image)
+{
+  std::shared_ptr<RomImage> result(new RomImage(), forget_image);
+  RomLoadError error = Cartridge::ParseHeader(data.get(), size, result->description, result->layout);
+  if (error != RomLoadError::None)
+    return error;
+
+  result->data = data;
+  if (path)
+    result->path = path;
+
+  // The same size the cartridge gives the PPU (see Cartridge::GetCHRROMSize()).
+  if (const u8 *chr_rom = result->GetCHRROM())
+  {
+    result->chr_rom_tiles.Attach(chr_rom, 0x2000 * result->description.CHR_ROM_8KB_Multiple);
+    result->chr_rom_tiles.DecodeAll();
+  }
+
+  image = result;
+  return RomLoadError::None;
+}
+
+RomLoadError RomImage::Load(const char *path, std::shared_ptr<const RomImage> &image)
+{
+  struct stat info;
+  if (stat(path, &info) != 0)
+    return RomLoadError::CannotOpen;
+
+  ImageCache &cache = image_cache();
+  std::shared_ptr<std::mutex> loading;
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    LoadedImage &loaded = cache.images[path];
+    if (!loaded.loading)
+      loaded.loading.reset(new std::mutex());
+    loading = loaded.loading;
+  }
+
+  std::lock_guard<std::mutex> load_lock(*loading);
+
+  // Whoever held 'loading' before may have just loaded it.
+  std::shared_ptr<const RomImage> loaded_image;
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto found = cache.images.find(path);
+    if (found != cache.images.end() && same_file(found->second, info))
+      loaded_image = found->second.image.lock();
+  }
+  if (loaded_image)
+  {
+    image = loaded_image;
+    return RomLoadError::None;
+  }
+
+  std::shared_ptr<const u8> data;
+  size_t size;
+  RomLoadError error = MapFile(path, data, size) ? create(data, size, path, loaded_image) : RomLoadError::CannotOpen;
+
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (error == RomLoadError::None)
+    {
+      cache.images[path] = {loaded_image, info.st_dev, info.st_ino, info.st_size, modified_time(info), loading};
+    }
+    else
+    {
+      auto found = cache.images.find(path);
+      if (found != cache.images.end() && found->second.image.expired())
+        cache.images.erase(found);
+    }
+  }
+
+  if (error == RomLoadError::None)
+    image = loaded_image;
+  return error;
+}
+
+RomLoadError RomImage::FromMemory(const u8 *data, size_t size, std::shared_ptr<const RomImage> &image)
+{
+  return create(std::shared_ptr<const u8>(data, [](const u8 *) {}), size, nullptr, image);
+}
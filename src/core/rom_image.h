@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "core/cartridge.h"
+#include "core/tile_cache.h"
+
+// A ROM as loaded: its file's mapping, what the header says, and CHR-ROM already decoded
+// for the PPU. It never changes once made, so any number of cartridges (the per-console
+// mapper state, see Cartridge) share one, however many threads they run on.
+//
+// Images loaded from a file are kept, for as long as anything uses them, by path: loading
+// the same file again, e.g. for the next of many consoles, is a stat() and a lookup.
+class RomImage
+{
+private:
+  std::shared_ptr<const u8> data;
+  std::string path;
+  CartridgeDescription description;
+  RomLayout layout;
+
+  // Decoded in full up front (see TileCache::DecodeAll()), so sharing needs no locking.
+  TileCache chr_rom_tiles;
+
+  static RomLoadError create(std::shared_ptr<const u8> data, size_t size, const char *path, std::shared_ptr<const RomImage> &image);
+
+public:
+  // The image of the file at 'path', loaded now or shared with whoever loaded it last, if
+  // the file has not changed since.
+  static RomLoadError Load(const char *path, std::shared_ptr<const RomImage> &image);
+
+  // An image of a ROM already in memory, which has to outlive it. Never shared.
+  static RomLoadError FromMemory(const u8 *data, size_t size, std::shared_ptr<const RomImage> &image);
+
+  // Where it was loaded from; empty if it was in memory.
+  const std::string &GetPath() const { return path; }
+
+  const CartridgeDescription &GetDescription() const { return description; }
+  const RomLayout &GetLayout() const { return layout; }
+
+  const u8 *GetPRGROM() const { return data.get() + layout.PRGOffset; }
+  const u8 *GetCHRROM() const { return layout.CHRSize ? data.get() + layout.CHROffset : nullptr; }
+
+  // CHR-ROM decoded, for TileCache::Share(); not attached to anything on CHR-RAM boards.
+  const TileCache &GetCHRROMTiles() const { return chr_rom_tiles; }
+};
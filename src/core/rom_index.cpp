@@ -0,0 +1,100 @@
+#include "core/rom_index.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "core/content_hash.h"
+#include "core/mapped_file.h"
+
+static const char MAGIC[8] = {'Q', 'N', 'E', 'S', 'R', 'O', 'M', 'I'};
+
+static bool entry_less(const RomIndexEntry &a, const RomIndexEntry &b)
+{
+  if (a.CRC32 != b.CRC32)
+    return a.CRC32 < b.CRC32;
+  return memcmp(a.SHA1, b.SHA1, sizeof(a.SHA1)) < 0;
+}
+
+bool RomIndex::Open(const char *path)
+{
+  std::shared_ptr<const u8> mapped;
+  size_t size;
+  if (!MapFile(path, mapped, size) || size < sizeof(RomIndexHeader))
+    return false;
+
+  RomIndexHeader header;
+  memcpy(&header, mapped.get(), sizeof(header));
+  if (memcmp(header.Magic, MAGIC, sizeof(MAGIC)) != 0 || header.Version != VERSION)
+    return false;
+
+  const u64 entries_size = (u64)header.EntryCount * sizeof(RomIndexEntry);
+  if (size != sizeof(RomIndexHeader) + entries_size + header.PathsSize)
+    return false;
+
+  data = mapped;
+  entries = (const RomIndexEntry *)(data.get() + sizeof(RomIndexHeader));
+  entry_count = header.EntryCount;
+  paths = (const char *)data.get() + sizeof(RomIndexHeader) + entries_size;
+  paths_size = header.PathsSize;
+  return true;
+}
+
+bool RomIndex::Write(const char *path, std::vector<RomIndexEntry> entries, const std::string &paths)
+{
+  std::sort(entries.begin(), entries.end(), entry_less);
+
+  RomIndexHeader header = {};
+  memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+  header.Version = VERSION;
+  header.EntryCount = entries.size();
+  header.PathsSize = paths.size();
+
+  // Write beside the old index, then swap it in.
+  const std::string temp_path = std::string(path) + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "wb");
+  if (!file)
+    return false;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  if (!entries.empty())
+    ok = ok && fwrite(entries.data(), sizeof(RomIndexEntry), entries.size(), file) == entries.size();
+  if (!paths.empty())
+    ok = ok && fwrite(paths.data(), 1, paths.size(), file) == paths.size();
+  ok = fclose(file) == 0 && ok;
+
+  if (!ok || rename(temp_path.c_str(), path) != 0)
+  {
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+const char *RomIndex::GetPath(const RomIndexEntry &entry) const
+{
+  // Anything out of range, or not terminated, comes back empty rather than reading past
+  // the end of the mapping.
+  if (entry.PathOffset >= paths_size || !memchr(paths + entry.PathOffset, 0, paths_size - entry.PathOffset))
+    return "";
+  return paths + entry.PathOffset;
+}
+
+const RomIndexEntry *RomIndex::Find(u32 crc32, const u8 *sha1) const
+{
+  RomIndexEntry key = {};
+  key.CRC32 = crc32;
+  if (sha1)
+    memcpy(key.SHA1, sha1, sizeof(key.SHA1));
+
+  const RomIndexEntry *end = entries + entry_count;
+  const RomIndexEntry *found = std::lower_bound(entries, end, key, entry_less);
+  if (found == end || found->CRC32 != crc32)
+    return nullptr;
+  if (sha1 && memcmp(found->SHA1, sha1, sizeof(found->SHA1)) != 0)
+    return nullptr;
+  return found;
+}
+
+u32 RomIndex::ContentCRC32(const u8 *prg_rom, const RomLayout &layout)
+{
+  return CRC32(prg_rom, layout.PRGSize + layout.CHRSize);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "core/cartridge.h"
+#include "core/types.h"
+
+// An index of a ROM library, written by qnes_index_roms, so the emulator can pick out
+// supported ROMs and per-ROM settings without opening every file.
+//
+// The file is used in place through a read-only mapping: a header, then the entries sorted
+// by CRC-32 (then SHA-1), then the paths as NUL-terminated strings. Lookups are binary
+// searches. Everything is stored in the byte order of the machine that wrote it.
+
+enum RomIndexFlags : u8
+{
+  ROM_INDEX_SUPPORTED = 1 << 0, // The mapper is implemented
+  ROM_INDEX_NES2 = 1 << 1,      // NES 2.0 header
+  ROM_INDEX_BATTERY = 1 << 2,   // Battery-backed PRG-RAM
+  ROM_INDEX_TRAINER = 1 << 3,   // Has a 512 byte trainer
+  ROM_INDEX_VERTICAL = 1 << 4,  // Hardwired vertical mirroring
+  ROM_INDEX_FOUR_SCREEN = 1 << 5,
+};
+
+// No override for this setting: use the emulator's default.
+static const u8 ROM_INDEX_NO_OVERRIDE = 0xFF;
+
+struct RomIndexEntry
+{
+  u32 CRC32;      // Of PRG-ROM followed by CHR-ROM, as ROM databases use
+  u8 SHA1[20];    // Likewise
+  u32 PathOffset; // Into the path strings
+  u32 PRGSize;    // In bytes
+  u32 CHRSize;    // In bytes; 0 for CHR-RAM
+  u16 MapperNumber;
+  u8 SubmapperNumber;
+  u8 Flags; // RomIndexFlags
+
+  // Per-ROM overrides, or ROM_INDEX_NO_OVERRIDE
+  u8 PPUBackend; // A PPUBackend
+
+  u8 Reserved[7];
+};
+static_assert(sizeof(RomIndexEntry) == 48, "RomIndexEntry is part of the file format");
+
+struct RomIndexHeader
+{
+  char Magic[8]; // "QNESROMI"
+  u32 Version;
+  u32 EntryCount;
+  u32 PathsSize;
+  u32 Reserved;
+};
+static_assert(sizeof(RomIndexHeader) == 24, "RomIndexHeader is part of the file format");
+
+class RomIndex
+{
+private:
+  std::shared_ptr<const u8> data;
+  const RomIndexEntry *entries;
+  u32 entry_count;
+  const char *paths;
+  u32 paths_size;
+
+public:
+  static const u32 VERSION = 1;
+
+  RomIndex() : entries(nullptr), entry_count(0), paths(nullptr), paths_size(0) {}
+
+  // Map the index at 'path'. Returns false if it is missing or not a valid index.
+  bool Open(const char *path);
+
+  // Sort 'entries' and write them, with 'paths' (which their PathOffsets point into), to
+  // 'path'. The file is replaced in one go, so readers never see half of it.
+  static bool Write(const char *path, std::vector<RomIndexEntry> entries, const std::string &paths);
+
+  u32 GetEntryCount() const { return entry_count; }
+  const RomIndexEntry &GetEntry(u32 i) const { return entries[i]; }
+  const char *GetPath(const RomIndexEntry &entry) const;
+
+  // The first entry with this CRC-32 (and SHA-1, if given), or nullptr. Identical ROMs at
+  // different paths follow it.
+  const RomIndexEntry *Find(u32 crc32, const u8 *sha1 = nullptr) const;
+
+  // The CRC-32 entries are found by: of the exact PRG-ROM and CHR-ROM sizes in 'layout'
+  // (which the 16KB and 8KB multiples in CartridgeDescription round down), starting at
+  // 'prg_rom', with CHR-ROM right after it as in the file.
+  static u32 ContentCRC32(const u8 *prg_rom, const RomLayout &layout);
+};
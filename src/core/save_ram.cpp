@@ -0,0 +1,248 @@
+#include "core/save_ram.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+// The background thread, and the save files it looks after. The mutex only ever guards the
+// list and the settings; nothing holds it while waiting on the disk.
+struct SaveFlusher
+{
+  std::mutex mutex;
+  std::vector<std::shared_ptr<SaveFile>> files;
+  std::thread thread;
+  std::condition_variable wake;
+  bool stopping;
+  u32 interval_ms;
+
+  SaveFlusher() : stopping(false), interval_ms(SaveRAM::DEFAULT_FLUSH_INTERVAL_MS) {}
+};
+
+void stop_flusher();
+
+// Never destroyed, so a SaveRAM outliving the exit hook still finds its mutex. The hook is
+// registered with it, before any save file is opened, so it runs after every static object
+// made after that has gone, and before any made earlier.
+SaveFlusher &flusher()
+{
+  static SaveFlusher *instance = []() {
+    SaveFlusher *flusher = new SaveFlusher();
+    atexit(stop_flusher);
+    return flusher;
+  }();
+  return *instance;
+}
+
+// Write out the pages written since last time, or all of it once it is closed.
+void sync_file(SaveFile &file, bool everything)
+{
+  if (everything)
+  {
+    msync(file.data, file.size, MS_SYNC);
+    return;
+  }
+
+  for (u64 pages = file.dirty_pages.exchange(0, std::memory_order_acquire); pages; pages &= pages - 1)
+  {
+    const u32 offset = __builtin_ctzll(pages) << file.page_shift;
+    msync(file.data + offset, std::min(file.size - offset, 1u << file.page_shift), MS_SYNC);
+  }
+}
+
+void run_flusher(SaveFlusher &flusher)
+{
+  std::vector<std::shared_ptr<SaveFile>> files;
+  std::unique_lock<std::mutex> lock(flusher.mutex);
+
+  while (!flusher.stopping)
+  {
+    flusher.wake.wait_for(lock, std::chrono::milliseconds(flusher.interval_ms));
+    files = flusher.files;
+    lock.unlock();
+
+    // Closed files are finished with here, and dropped from the list; the last reference
+    // going, below, unmaps them.
+    std::vector<SaveFile *> finished;
+    for (const std::shared_ptr<SaveFile> &file : files)
+    {
+      const bool closed = file->closed.load(std::memory_order_acquire);
+      sync_file(*file, closed);
+      if (closed)
+        finished.push_back(file.get());
+    }
+
+    lock.lock();
+    auto done = [&](const std::shared_ptr<SaveFile> &file) {
+      return std::find(finished.begin(), finished.end(), file.get()) != finished.end();
+    };
+    flusher.files.erase(std::remove_if(flusher.files.begin(), flusher.files.end(), done), flusher.files.end());
+    lock.unlock();
+    files.clear();
+    lock.lock();
+  }
+}
+
+void stop_flusher()
+{
+  SaveFlusher &flusher = ::flusher();
+  std::vector<std::shared_ptr<SaveFile>> files;
+  {
+    std::lock_guard<std::mutex> lock(flusher.mutex);
+    flusher.stopping = true;
+  }
+  flusher.wake.notify_one();
+  if (flusher.thread.joinable())
+    flusher.thread.join();
+
+  {
+    std::lock_guard<std::mutex> lock(flusher.mutex);
+    files.swap(flusher.files);
+  }
+
+  // Everything, open or not: the program is on its way out.
+  for (const std::shared_ptr<SaveFile> &file : files)
+    sync_file(*file, true);
+}
+
+// Whether a SaveRAM has the file open. Called with the flusher's mutex held. A file closed
+// but not yet written out can be opened again: both mappings are of the same pages.
+bool is_open(const SaveFlusher &flusher, dev_t device, ino_t inode)
+{
+  for (const std::shared_ptr<SaveFile> &file : flusher.files)
+    if (file->device == device && file->inode == inode && !file->closed.load(std::memory_order_relaxed))
+      return true;
+  return false;
+}
+
+// Make 'fd' at least 'size' bytes long. The zeros are written rather than left as a hole,
+// so the blocks are allocated now and not on the game's first write to each page.
+bool extend_file(int fd, off_t from, u32 size)
+{
+  static const u8 zeros[4096] = {};
+  for (off_t offset = from; offset < size;)
+  {
+    const ssize_t written = pwrite(fd, zeros, std::min<off_t>(sizeof(zeros), size - offset), offset);
+    if (written <= 0)
+      return false;
+    offset += written;
+  }
+  return true;
+}
+
+} // namespace
+
+SaveFile::SaveFile(dev_t device, ino_t inode, u8 *data, u32 size, u32 page_shift)
+    : device(device), inode(inode), data(data), size(size), page_shift(page_shift), dirty_pages(0), closed(false)
+{
+}
+
+SaveFile::~SaveFile()
+{
+  munmap(data, size);
+}
+
+SaveRAM::SaveRAM(std::shared_ptr<SaveFile> file)
+    : file(file), data(file->data), size(file->size), page_shift(file->page_shift), dirty_pages(file->dirty_pages)
+{
+}
+
+SaveRAM *SaveRAM::Open(const char *path, u32 size)
+{
+  if (size == 0 || size > MAX_SIZE)
+    return nullptr;
+
+  // Turned away before anything is done to the file, if it is there already. Checked again
+  // below, as it may be opened in the meantime.
+  SaveFlusher &flusher = ::flusher();
+  struct stat file_info;
+  if (stat(path, &file_info) == 0)
+  {
+    std::lock_guard<std::mutex> lock(flusher.mutex);
+    if (is_open(flusher, file_info.st_dev, file_info.st_ino))
+      return nullptr;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return nullptr;
+
+  if (fstat(fd, &file_info) != 0 || (file_info.st_size < size && !extend_file(fd, file_info.st_size, size)))
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  // Shared, so writes go to the file; populated up front, so the first access to a page
+  // does not wait on the disk.
+#ifdef MAP_POPULATE
+  void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+#else
+  void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#endif
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return nullptr;
+
+  // Dirty bits are per system page (msync's unit), but never smaller than 4KB, so that
+  // MAX_SIZE fits in them.
+  u32 page_shift = 12;
+  while ((1l << page_shift) < sysconf(_SC_PAGESIZE))
+    page_shift++;
+
+#ifndef MAP_POPULATE
+  // Without MAP_POPULATE (macOS), reading a byte of each page brings it in instead.
+  for (u32 offset = 0; offset < size; offset += 1u << page_shift)
+    (void)*(volatile u8 *)((u8 *)mapping + offset);
+#endif
+
+  std::shared_ptr<SaveFile> file = std::make_shared<SaveFile>(file_info.st_dev, file_info.st_ino, (u8 *)mapping, size, page_shift);
+
+  std::lock_guard<std::mutex> lock(flusher.mutex);
+  if (is_open(flusher, file->device, file->inode))
+    return nullptr;
+
+  flusher.files.push_back(file);
+  if (!flusher.thread.joinable() && !flusher.stopping)
+    flusher.thread = std::thread(run_flusher, std::ref(flusher));
+  return new SaveRAM(file);
+}
+
+void SaveRAM::SetFlushInterval(u32 milliseconds)
+{
+  if (milliseconds < MIN_FLUSH_INTERVAL_MS)
+    milliseconds = MIN_FLUSH_INTERVAL_MS;
+
+  SaveFlusher &flusher = ::flusher();
+  {
+    std::lock_guard<std::mutex> lock(flusher.mutex);
+    flusher.interval_ms = milliseconds;
+  }
+  flusher.wake.notify_one();
+}
+
+SaveRAM::~SaveRAM()
+{
+  SaveFlusher &flusher = ::flusher();
+  bool stopped;
+  {
+    std::lock_guard<std::mutex> lock(flusher.mutex);
+    file->closed.store(true, std::memory_order_release);
+    stopped = flusher.stopping;
+  }
+
+  // Past the exit hook there is no thread left to do it.
+  if (stopped)
+    sync_file(*file, true);
+  else
+    flusher.wake.notify_one();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <sys/types.h>
+#include "core/types.h"
+
+// Battery-backed RAM, kept in a save file through a shared mapping of it: what the game
+// writes lands in the file's page cache pages straight away, so it survives the emulator
+// crashing, and the emulation thread never makes a system call for it.
+//
+// Getting it onto the disk is left to one background thread shared by every save file: the
+// emulation thread notes which pages it wrote (see NoteWrite()), and every flush interval
+// the thread msyncs those pages. When the RAM goes away, the thread writes all of it out
+// and unmaps it; at exit, whatever is still open is written out on the way down.
+
+// A save file's mapping. Shared by its SaveRAM and the flusher thread, so the last sync
+// and the unmap can happen on the thread after the SaveRAM is gone.
+struct SaveFile
+{
+  // Which file it is, however it was named
+  dev_t device;
+  ino_t inode;
+
+  u8 *data;
+  u32 size;
+  u32 page_shift;
+
+  // A bit per page written since the flusher last took them
+  std::atomic<u64> dirty_pages;
+
+  // Set once the SaveRAM has gone: nothing writes to it any more.
+  std::atomic<bool> closed;
+
+  SaveFile(dev_t device, ino_t inode, u8 *data, u32 size, u32 page_shift);
+  ~SaveFile();
+};
+
+class SaveRAM
+{
+private:
+  std::shared_ptr<SaveFile> file;
+
+  // The file's, kept here for NoteWrite()
+  u8 *data;
+  u32 size;
+  u32 page_shift;
+  std::atomic<u64> &dirty_pages;
+
+  SaveRAM(std::shared_ptr<SaveFile> file);
+
+public:
+  // The most a save file holds; with the smallest pages, one u64 of dirty bits covers it.
+  static const u32 MAX_SIZE = 0x40000;
+
+  static const u32 DEFAULT_FLUSH_INTERVAL_MS = 1000;
+
+  // Shorter intervals are taken as this: the thread would be busy doing nothing.
+  static const u32 MIN_FLUSH_INTERVAL_MS = 10;
+
+  // Map the first 'size' bytes of the file at 'path', creating it, or extending it with
+  // zeros, as needed. Returns nullptr if it cannot, or if it is open already: consoles
+  // running the same game do not share its RAM.
+  static SaveRAM *Open(const char *path, u32 size);
+
+  // How often the background thread writes out what has changed, for all save files; no
+  // less than MIN_FLUSH_INTERVAL_MS.
+  static void SetFlushInterval(u32 milliseconds);
+
+  // Hands the file to the flusher thread to write out in full and unmap; never waits for it.
+  ~SaveRAM();
+
+  u8 *GetData() const { return data; }
+  u32 GetSize() const { return size; }
+
+  // After each write to GetData(): marks the byte's page for the flusher. Almost always a
+  // relaxed load that finds the bit already set.
+  void NoteWrite(const u8 *byte)
+  {
+    const u32 offset = byte - data;
+    if (offset >= size)
+      return;
+
+    const u64 page = 1ull << (offset >> page_shift);
+    if (!(dirty_pages.load(std::memory_order_relaxed) & page))
+      dirty_pages.fetch_or(page, std::memory_order_relaxed);
+  }
+};
@@ -17,6 +17,8 @@ struct PPURegisterState
   u8 scroll_x;
   u8 scroll_y;
   u16 vram_addr;
+  u16 temp_vram_addr;
+  u8 fine_x_scroll;
 
   u8 PPUCTRL;
   u8 PPUSTATUS;
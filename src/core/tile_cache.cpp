@@ -0,0 +1,60 @@
+#include <cstring>
+#include "core/tile_cache.h"
+
+void TileCache::Attach(const u8 *chr, u32 size)
+{
+  this->chr = chr;
+  num_tiles = size / 16;
+
+  own_pixels.reset(num_tiles ? new u8[TILE_BYTES * num_tiles] : nullptr);
+  own_valid.reset(num_tiles ? new u8[num_tiles] : nullptr);
+  pixels = own_pixels.get();
+  valid = own_valid.get();
+  InvalidateAll();
+}
+
+void TileCache::DecodeAll()
+{
+  for (u32 tile = 0; tile < num_tiles; ++tile)
+    if (!valid[tile])
+      decode(tile);
+}
+
+void TileCache::Share(const TileCache &decoded)
+{
+  chr = decoded.chr;
+  num_tiles = decoded.num_tiles;
+  own_pixels.reset();
+  own_valid.reset();
+
+  // Nothing writes through these: every tile is valid, so Row() never decodes.
+  pixels = decoded.pixels;
+  valid = decoded.valid;
+}
+
+void TileCache::InvalidateAll()
+{
+  if (num_tiles)
+    memset(valid, 0, num_tiles);
+}
+
+void TileCache::decode(u32 tile)
+{
+  const u8 *planes = &chr[16 * tile];
+  u8 *out = &pixels[TILE_BYTES * tile];
+
+  for (int y = 0; y < 8; ++y)
+  {
+    const u8 lo_bits = planes[y];
+    const u8 hi_bits = planes[y + 8];
+
+    for (int x = 0; x < 8; ++x)
+    {
+      const u8 color = ((lo_bits >> (7 - x)) & 1) | (((hi_bits >> (7 - x)) & 1) << 1);
+      out[8 * y + x] = color;
+      out[64 + 8 * y + (7 - x)] = color;
+    }
+  }
+
+  valid[tile] = 1;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include "core/types.h"
+
+// Pattern table tiles, pre-expanded from 2bpp planar data into one byte (0-3) per pixel.
+// Each 16-byte tile of CHR memory becomes 8 rows of 8 pixels, plus the same rows mirrored
+// horizontally for flipped sprites. Tiles are indexed by their physical offset in CHR
+// memory (offset / 16), so every bank mapping that points at a tile shares one decode.
+//
+// Tiles are decoded on first use; writers to the underlying memory (CHR-RAM) call
+// Invalidate() and the tile is decoded again the next time it is used. Memory that never
+// changes (CHR-ROM) can be decoded once and shared by many caches (see Share()).
+class TileCache
+{
+public:
+  TileCache() : chr(nullptr), num_tiles(0), pixels(nullptr), valid(nullptr) {}
+
+  // Point the cache at 'size' bytes of CHR memory. Drops everything decoded so far.
+  void Attach(const u8 *chr, u32 size);
+
+  // Decode every tile now, so Row() never writes to the cache again.
+  void DecodeAll();
+
+  // Use what 'decoded' has decoded (see DecodeAll()), without copying it; 'decoded' has to
+  // outlive this cache, and Invalidate() must not be called.
+  void Share(const TileCache &decoded);
+
+  bool IsAttached() const { return chr != nullptr; }
+  u32 GetNumTiles() const { return num_tiles; }
+
+  // Row 'y' (0-7) of tile 'tile', as 8 color indices left to right.
+  const u8 *Row(u32 tile, int y, bool flip_horizontal)
+  {
+    if (!valid[tile])
+      decode(tile);
+    return &pixels[TILE_BYTES * tile + (flip_horizontal ? 64 : 0) + 8 * y];
+  }
+
+  void Invalidate(u32 tile) { valid[tile] = 0; }
+  void InvalidateAll();
+
+private:
+  static const int TILE_BYTES = 2 * 8 * 8;
+
+  const u8 *chr;
+  u32 num_tiles;
+
+  // Left uninitialized until a tile is decoded, so large CHR-ROMs cost nothing up front.
+  // Either these, or another cache's (see Share()).
+  u8 *pixels;
+  u8 *valid;
+  std::unique_ptr<u8[]> own_pixels;
+  std::unique_ptr<u8[]> own_valid;
+
+  void decode(u32 tile);
+};
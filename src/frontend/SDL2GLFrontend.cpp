@@ -113,6 +113,11 @@ SDL2GLFrontend::SDL2GLFrontend(std::shared_ptr<Console> console) noexcept
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
+  framebuffer_pixels.reset(new u32[256 * 240]);
+  console->SetFrameOutput(framebuffer_pixels.get(), 256 * sizeof(u32), PixelFormat::RGBA8888);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 240, 0, GL_RGBA, GL_UNSIGNED_BYTE, framebuffer_pixels.get());
+  uploaded_frame_count = console->GetFrameCount();
+
   // VAO
   glGenVertexArrays(1, &vao);
   glBindVertexArray(vao);
@@ -177,12 +182,40 @@ SDL2GLFrontend::SDL2GLFrontend(std::shared_ptr<Console> console) noexcept
 
 SDL2GLFrontend::~SDL2GLFrontend()
 {
+  console->SetFrameOutput(nullptr, 0, PixelFormat::RGBA8888);
   delete ppu_window;
   delete cpu_window;
   delete imgui_context;
   delete window;
 }
 
+void SDL2GLFrontend::upload_framebuffer()
+{
+  // While paused the debugger can step the PPU part way through a frame, so just send it all.
+  if (console->GetCPU()->IsPaused())
+  {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 240, GL_RGBA, GL_UNSIGNED_BYTE, framebuffer_pixels.get());
+    return;
+  }
+
+  // Otherwise only the lines that changed in a new frame need to go.
+  if (console->GetFrameCount() == uploaded_frame_count)
+    return;
+  uploaded_frame_count = console->GetFrameCount();
+
+  std::shared_ptr<PPU> ppu = console->GetPPU();
+  if (!ppu->GetDirtyLineCount())
+    return;
+
+  int first = 0, last = 239;
+  while (!ppu->IsLineDirty(first))
+    first++;
+  while (!ppu->IsLineDirty(last))
+    last--;
+
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, 256, last - first + 1, GL_RGBA, GL_UNSIGNED_BYTE, &framebuffer_pixels[256 * first]);
+}
+
 void SDL2GLFrontend::MainLoop()
 {
   while (!should_close)
@@ -270,14 +303,13 @@ void SDL2GLFrontend::MainLoop()
     {
       glEnable(GL_TEXTURE_2D);
       glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
-      Texture &display(console->GetPPU()->GetFrameBufferTexture());
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, display.GetWidth(), display.GetHeight(), 0, GL_RGB, GL_UNSIGNED_BYTE, display.Data());
+      upload_framebuffer();
 
       // Combine the window aspect ratio and aspect ratio of the texture to be drawn
       // to produce width and height variables in [0,1] which will fit inside
       // a [-1,1] x [-1,1] square.
       float window_aspect = (float)gl_drawable_width / (float)gl_drawable_height;
-      float texture_aspect = (float)display.GetWidth() / (float)display.GetHeight();
+      float texture_aspect = 256.0f / 240.0f;
       window_aspect /= texture_aspect;
       float w = std::min(1.f, 1.f / window_aspect);
       float h = std::min(1.f, 1.f * window_aspect);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <thread>
 #include "frontend/Frontend.h"
 #include "core/types.h"
@@ -15,6 +16,12 @@ private:
   SDL_Window *window;
   bool should_close;
   u32 framebuffer_texture;
+
+  // The PPU writes each frame here as RGBA, ready to upload (see Console::SetFrameOutput()).
+  std::unique_ptr<u32[]> framebuffer_pixels;
+
+  // The frame the texture was last brought up to date with.
+  u32 uploaded_frame_count;
   ImGuiContext *imgui_context;
   std::shared_ptr<Console> console;
 
@@ -26,6 +33,7 @@ private:
 
 private:
   void imgui();
+  void upload_framebuffer();
 
 public:
   SDL2GLFrontend(std::shared_ptr<Console> console) noexcept;
@@ -125,7 +125,7 @@ void CPUWindow::render_disassembly(int disassembly_lines)
       {
         if (is_breakpoint)
         {
-          m_console->GetCPU()->DebuggingControls().Remove(entry.pc);
+          m_console->GetCPU()->DebuggingControls().Remove(entry.pc, Breakpoint::EXECUTE);
         }
         else
         {
@@ -161,6 +161,9 @@ void CPUWindow::render(bool embed)
   ImGui::Separator();
   ImGui::Columns(3);
 
+  static char condition_input[128] = {};
+  static std::string condition_error;
+
   /* Disassembly view */
   {
     static char address_input[32] = {};
@@ -196,9 +199,9 @@ void CPUWindow::render(bool embed)
       address_input[0] = 0;
     }
 
-    ImGui::SameLine();
-    if (ImGui::Button("Breakpoint"))
-    {
+    // Breakpoints and watchpoints share the address box, plus an optional condition
+    // such as "A == $40 && [$0300] > 3 && scanline < 20".
+    const auto add_breakpoint = [&](u8 mask) {
       const char *input = address_input;
       u16 address;
 
@@ -207,12 +210,36 @@ void CPUWindow::render(bool embed)
         input += 2;
       }
 
-      if (sscanf(input, "%hx", &address) == 1)
+      if (sscanf(input, "%hx", &address) != 1)
+        return;
+
+      std::shared_ptr<BreakpointCondition> condition;
+      if (condition_input[0])
       {
-        m_console->GetCPU()->DebuggingControls().Add(Breakpoint(address));
-        address_input[0] = 0;
+        condition = std::make_shared<BreakpointCondition>();
+        if (!condition->Compile(condition_input, condition_error))
+          return;
       }
-    }
+
+      m_console->GetCPU()->DebuggingControls().Add(Breakpoint(address, mask, condition));
+      address_input[0] = 0;
+      condition_input[0] = 0;
+      condition_error.clear();
+    };
+
+    ImGui::SameLine();
+    if (ImGui::Button("Breakpoint"))
+      add_breakpoint(Breakpoint::EXECUTE);
+
+    ImGui::SameLine();
+    if (ImGui::Button("Watch R"))
+      add_breakpoint(Breakpoint::READ);
+    HelperText("Break after an instruction reads this address");
+
+    ImGui::SameLine();
+    if (ImGui::Button("Watch W"))
+      add_breakpoint(Breakpoint::WRITE);
+    HelperText("Break after an instruction writes this address");
 
     // In both of the following lines where we step, we step the Console so that the PPU will also advance.
 
@@ -245,25 +272,41 @@ void CPUWindow::render(bool embed)
     ImGui::BeginChild("breakpoint_listing", ImVec2(0, -ImGui::GetItemsLineHeightWithSpacing()));
 
     const auto &breakpoints = m_console->GetCPU()->DebuggingControls().GetAll();
-    std::vector<u16> removals;
-    for (const auto breakpoint : breakpoints)
+    std::vector<Breakpoint> removals;
+    for (const auto &breakpoint : breakpoints)
     {
+      const Breakpoint &bp = breakpoint.second;
       char label[32];
-      snprintf(label, sizeof(label), "Remove##%d", breakpoint.first);
+      snprintf(label, sizeof(label), "Remove##%u", breakpoint.first);
       if (ImGui::Button(label))
       {
-        removals.push_back(breakpoint.first);
+        removals.push_back(bp);
       }
 
       ImGui::SameLine();
-      ImGui::TextColored((breakpoint.first == state.pc) ? color_hit : color_active, "0x%04x",
-                         breakpoint.first);
+      ImGui::TextColored((bp.addr == state.pc) ? color_hit : color_active, "0x%04x %c%c%c %s",
+                         bp.addr,
+                         (bp.mask & Breakpoint::READ) ? 'R' : '-',
+                         (bp.mask & Breakpoint::WRITE) ? 'W' : '-',
+                         (bp.mask & Breakpoint::EXECUTE) ? 'X' : '-',
+                         bp.condition ? bp.condition->GetText().c_str() : "");
     }
 
-    for (const auto removal : removals)
+    for (const Breakpoint &removal : removals)
       m_console->GetCPU()->DebuggingControls().Remove(removal);
 
     ImGui::EndChild();
+
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvailWidth() / 2);
+    ImGui::InputText("Condition##bpcondition", condition_input, sizeof(condition_input));
+    ImGui::PopItemWidth();
+    HelperText("Optional, e.g. A == $40 && [$0300] > 3 && scanline < 20");
+    if (!condition_error.empty())
+    {
+      ImGui::SameLine();
+      ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", condition_error.c_str());
+    }
+    ImGui::SameLine();
     if (ImGui::Button("Reboot"))
     {
       m_console->HardReset();
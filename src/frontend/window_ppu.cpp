@@ -9,6 +9,7 @@
 #include "frontend/imgui_memory_editor.h"
 
 static MemoryEditor ppu_mem_edit_window;
+static bool ppu_mem_edited = false;
 
 /*
 void HelperText(const char *text)
@@ -25,6 +26,10 @@ PPUWindow::PPUWindow(std::shared_ptr<Console> console, ImFont *font)
   ppu_mem_edit_window.GetLastPCForWrite = [&](u16 addr) -> u16 {
     return 0;
   };
+  ppu_mem_edit_window.WriteFn = [](u8 *data, size_t off, u8 d) {
+    data[off] = d;
+    ppu_mem_edited = true;
+  };
 
   state = new PPURegisterState;
 
@@ -81,9 +86,27 @@ void PPUWindow::render_registers()
     ImGui::SameLine();
     ImGui::Text("    VRAM %04X", state->vram_addr);
 
+    ImGui::SameLine();
+    ImGui::Text("    T %04X", state->temp_vram_addr);
+
+    ImGui::SameLine();
+    ImGui::Text("    Fine X %d", state->fine_x_scroll);
+
     ImGui::SameLine();
     ImGui::Text("    Raster X,Y (%d,%d)", state->pixel_x, state->pixel_y);
   }
+
+  /* Backend selection */
+  {
+    std::shared_ptr<PPU> ppu = m_console->GetPPU();
+    int backend = (int)ppu->GetBackend();
+    ImGui::SetNextItemWidth(120);
+    if (ImGui::Combo("Backend", &backend, "Fast\0Accurate\0Auto\0\0"))
+      ppu->SetBackend((PPUBackend)backend);
+
+    ImGui::SameLine();
+    ImGui::Text("    This frame: %s", ppu->IsAccurateFrame() ? "accurate" : "fast");
+  }
 }
 
 void PPUWindow::render(bool embed)
@@ -135,6 +158,11 @@ void PPUWindow::render(bool embed)
   {
     ImGui::BeginChild("ppu_memory_editor", ImVec2(0, -ImGui::GetItemsLineHeightWithSpacing()));
     ppu_mem_edit_window.DrawContents(m_console->GetPPU()->GetVRAM(), 0x4000, 0);
+    if (ppu_mem_edited)
+    {
+      m_console->GetPPU()->InvalidateVRAMCaches();
+      ppu_mem_edited = false;
+    }
     ImGui::EndChild();
   }
 
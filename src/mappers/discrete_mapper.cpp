@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "mappers/discrete_mapper.h"
+#include "core/types.h"
+
+// https://wiki.nesdev.com/w/index.php/Category:Discrete_logic_mappers
+static constexpr DiscreteMapperLayout LAYOUTS[] = {
+    // Mapper, name,
+    //   PRG window, shift, mask, fixed last bank,
+    //   CHR window address, size, shift, mask, CHR-RAM size, mirroring bit
+    {2, "UxROM", 0x4000, 0, 0xFF, true, 0x0000, 0x2000, 0, 0, 0x2000, -1},
+    {3, "CNROM", 0x8000, 0, 0, false, 0x0000, 0x2000, 0, 0xFF, 0x2000, -1},
+    {7, "AxROM", 0x8000, 0, 0x07, false, 0x0000, 0x2000, 0, 0, 0x2000, 4},
+    {11, "Color Dreams", 0x8000, 0, 0x03, false, 0x0000, 0x2000, 4, 0x0F, 0x2000, -1},
+    {13, "CPROM", 0x8000, 0, 0, false, 0x1000, 0x1000, 0, 0x03, 0x4000, -1},
+    {34, "BNROM", 0x8000, 0, 0xFF, false, 0x0000, 0x2000, 0, 0, 0x2000, -1},
+    {66, "GxROM", 0x8000, 4, 0x03, false, 0x0000, 0x2000, 0, 0x03, 0x2000, -1},
+};
+
+const DiscreteMapperLayout *FindDiscreteMapperLayout(int mapper_number)
+{
+  for (const DiscreteMapperLayout &layout : LAYOUTS)
+    if (layout.MapperNumber == mapper_number)
+      return &layout;
+  return nullptr;
+}
+
+// 'description', with at least as much CHR-RAM as the board has, if it has any.
+static CartridgeDescription with_chr_ram(CartridgeDescription description, u32 size)
+{
+  if (description.CHRRAMSize)
+    description.CHRRAMSize = std::max(description.CHRRAMSize, size);
+  return description;
+}
+
+DiscreteMapper::DiscreteMapper(const DiscreteMapperLayout &layout, CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom) noexcept
+    : Cartridge(with_chr_ram(description, layout.CHRRAMSize), prg_rom, chr_rom), layout(layout), latch(-1)
+{
+  // The fixed parts of the layout never move.
+  if (layout.PRGFixLastBank)
+    MapPRGROM(0xC000, 0x4000, 0x4000 * (description.PRG_ROM_16KB_Multiple - 1));
+  MapCHRMemory(0x0000, 0x2000, 0);
+
+  // The latch powers up cleared on most boards.
+  setLatch(0);
+}
+
+void DiscreteMapper::setLatch(u8 val)
+{
+  // Banks only move when the bits change; games often write the same value again.
+  if (val == latch)
+    return;
+  latch = val;
+
+  MapPRGROM(0x8000, layout.PRGWindowSize, layout.PRGWindowSize * ((val >> layout.PRGBankShift) & layout.PRGBankMask));
+  MapCHRMemory(layout.CHRWindowAddr, layout.CHRWindowSize, layout.CHRWindowSize * ((val >> layout.CHRBankShift) & layout.CHRBankMask));
+
+  if (layout.OneScreenMirroringBit >= 0)
+    SetMirroring((val >> layout.OneScreenMirroringBit) & 1 ? MirroringMode::OneScreenHigh : MirroringMode::OneScreenLow);
+}
+
+bool DiscreteMapper::CPUWrite(u16 addr, u8 val)
+{
+  if (addr < 0x8000)
+    return false;
+
+  setLatch(val);
+  return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "core/cartridge.h"
+
+// Boards built from discrete logic (UxROM, CNROM, AxROM, ...) are all a single latch
+// written anywhere in $8000-$FFFF, whose bits pick a PRG-ROM bank, a CHR bank and maybe the
+// mirroring. They only differ in which bits do what, so each is described by a layout and
+// one class does the rest.
+struct DiscreteMapperLayout
+{
+  u16 MapperNumber;
+  const char *Name;
+
+  // A PRGWindowSize window of PRG-ROM at $8000, picked by (latch >> PRGBankShift) &
+  // PRGBankMask; a mask of 0 fixes it to the first bank. With PRGFixLastBank, the window
+  // is 16KB and $C000-$FFFF stays on the last 16KB.
+  u32 PRGWindowSize;
+  u8 PRGBankShift;
+  u8 PRGBankMask;
+  bool PRGFixLastBank;
+
+  // Likewise for a CHRWindowSize window of CHR memory at CHRWindowAddr. The rest of the
+  // pattern tables stays on the start of CHR memory.
+  u16 CHRWindowAddr;
+  u16 CHRWindowSize;
+  u8 CHRBankShift;
+  u8 CHRBankMask;
+
+  // The least CHR-RAM the board has, where it has any.
+  u32 CHRRAMSize;
+
+  // The latch bit that picks one-screen mirroring (low or high page), or -1 for the
+  // mirroring the header says.
+  i8 OneScreenMirroringBit;
+};
+
+// The layout of discrete mapper 'mapper_number', or nullptr if it is not one.
+const DiscreteMapperLayout *FindDiscreteMapperLayout(int mapper_number);
+
+class DiscreteMapper : public Cartridge
+{
+private:
+  const DiscreteMapperLayout &layout;
+
+  // What the latch was last set to, as all banks follow from it.
+  int latch;
+
+  void setLatch(u8 val);
+
+public:
+  DiscreteMapper(const DiscreteMapperLayout &layout, CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom) noexcept;
+
+  bool CPUWrite(u16 addr, u8 val) final;
+};
@@ -4,15 +4,8 @@
 
 class Mapper_000 : public Cartridge
 {
-private:
-  CartridgeDescription description;
-
 public:
-  Mapper_000(CartridgeDescription description) noexcept;
+  Mapper_000(CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom) noexcept;
 
-  bool CPURead(u16 addr, u8 &val) final;
   bool CPUWrite(u16 addr, u8 val) final;
-
-  bool PPURead(u16 addr, u8 &val) final;
-  bool PPUWrite(u16 addr, u8 val) final;
 };
\ No newline at end of file
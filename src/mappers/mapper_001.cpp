@@ -1,47 +1,20 @@
 #include "mappers/mapper_001.h"
 #include "core/types.h"
 
-Mapper_001::Mapper_001(CartridgeDescription description) noexcept
-    : description(description)
+Mapper_001::Mapper_001(CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom) noexcept
+    : Cartridge(description, prg_rom, chr_rom)
 {
-  PRG_RAM = new u8[0x2000];
-
   PRGSelect = 0;
   ControlRegister = 0b01111;
   updateOffsets();
-}
-
-Mapper_001::~Mapper_001()
-{
-  delete[] PRG_RAM;
-}
 
-// MMC1
-bool Mapper_001::CPURead(u16 addr, u8 &val)
-{
   // CPU $6000-$7FFF: 8 KB PRG RAM bank, (optional)
   // CPU $8000-$BFFF: 16 KB PRG ROM bank, either switchable or fixed to the first bank
   // CPU $C000-$FFFF: 16 KB PRG ROM bank, either fixed to the last bank or switchable
-
-  if (addr < 0x6000)
-    return false;
-
-  if (addr < 0x8000)
-  {
-    int offset = addr - 0x6000;
-    val = PRG_RAM[offset];
-  }
-  else
-  {
-    addr -= 0x8000;
-    int bank = addr / 0x4000;
-    int offset = addr % 0x4000;
-    val = PRG_ROM[PRGOffsets[bank] + offset];
-  }
-
-  return true;
+  MapPRGRAM(0x6000, 0x2000, 0);
 }
 
+// MMC1
 bool Mapper_001::CPUWrite(u16 addr, u8 val)
 {
   if (addr < 0x6000)
@@ -51,13 +24,10 @@ bool Mapper_001::CPUWrite(u16 addr, u8 val)
     return false;
   }
 
-  // First handle RAM. Everything else uses the shift register
+  // RAM writes go straight through its slot (see MapPRGRAM()), so everything that gets
+  // here uses the shift register
   if (addr < 0x8000)
-  {
-    int offset = addr - 0x6000;
-    PRG_RAM[offset] = val;
-    return true;
-  }
+    return false;
 
   // Writing with bit 7 set, this write just resets the shift register
   if (val & 0x80)
@@ -84,20 +54,19 @@ bool Mapper_001::CPUWrite(u16 addr, u8 val)
     {
       ControlRegister = shift_register;
 
-      // TODO
       switch (ControlRegister & 3)
       {
       case 0:
-        //cartridge.NametableMirroring = NametableMirroringMode.OneScreenLowBank;
+        SetMirroring(MirroringMode::OneScreenLow);
         break;
       case 1:
-        //cartridge.NametableMirroring = NametableMirroringMode.OneScreenHighBank;
+        SetMirroring(MirroringMode::OneScreenHigh);
         break;
       case 2:
-        description.HardwiredMirroringModeIsVertical = 1;
+        SetMirroring(MirroringMode::Vertical);
         break;
       case 3:
-        description.HardwiredMirroringModeIsVertical = 0;
+        SetMirroring(MirroringMode::Horizontal);
         break;
       }
     }
@@ -125,22 +94,11 @@ bool Mapper_001::CPUWrite(u16 addr, u8 val)
   return true;
 }
 
-bool Mapper_001::PPURead(u16 addr, u8 &val)
+void Mapper_001::updateOffsets()
 {
   // PPU $0000-$0FFF: 4 KB switchable CHR bank
   // PPU $1000-$1FFF: 4 KB switchable CHR bank
 
-  if (addr < 0x2000)
-  {
-    int bank = addr / 0x1000;
-    val = CHR_ROM[CHROffsets[bank] | (addr & 0xFFF)];
-    return true;
-  }
-  return false;
-}
-
-void Mapper_001::updateOffsets()
-{
   // CHR0 and CHR1
   if ((ControlRegister & 0x10) == 0)
   {
@@ -154,6 +112,8 @@ void Mapper_001::updateOffsets()
     CHROffsets[0] = 0x1000 * (CHR0Select & 0x1F);
     CHROffsets[1] = 0x1000 * (CHR1Select & 0x1F);
   }
+  MapCHRMemory(0x0000, 0x1000, CHROffsets[0]);
+  MapCHRMemory(0x1000, 0x1000, CHROffsets[1]);
 
   // PRG Select
   if ((ControlRegister & 0x08) == 0)
@@ -177,9 +137,6 @@ void Mapper_001::updateOffsets()
       PRGOffsets[1] = 0x4000 * (description.PRG_ROM_16KB_Multiple - 1);
     }
   }
-}
-
-bool Mapper_001::PPUWrite(u16 addr, u8 val)
-{
-  return false;
+  MapPRGROM(0x8000, 0x4000, PRGOffsets[0]);
+  MapPRGROM(0xC000, 0x4000, PRGOffsets[1]);
 }
@@ -0,0 +1,119 @@
+#include <cstring>
+#include "mappers/mapper_004.h"
+#include "core/types.h"
+
+// MMC3 (TxROM)
+Mapper_004::Mapper_004(CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom) noexcept
+    : Cartridge(description, prg_rom, chr_rom)
+{
+  BankSelect = 0;
+  memset(BankRegisters, 0, sizeof(BankRegisters));
+  IRQLatch = 0;
+  IRQCounter = 0;
+  IRQReload = false;
+  IRQEnabled = false;
+  has_scanline_counter = true;
+
+  // The PRG RAM protect bits in $A001 are not honoured, as on most emulators: MMC6 uses
+  // them differently, and some MMC3 games never enable the RAM they use.
+  MapPRGRAM(0x6000, 0x2000, 0);
+  updateBanks();
+}
+
+bool Mapper_004::CPUWrite(u16 addr, u8 val)
+{
+  if (addr < 0x8000)
+    return false;
+
+  // Each 8KB range has two registers, picked by the lowest address bit.
+  const bool odd = addr & 1;
+  if (addr < 0xA000)
+  {
+    if (odd)
+      BankRegisters[BankSelect & 7] = val;
+    else
+      BankSelect = val;
+    updateBanks();
+  }
+  else if (addr < 0xC000)
+  {
+    if (!odd && mirroring != MirroringMode::FourScreen)
+      SetMirroring(val & 1 ? MirroringMode::Horizontal : MirroringMode::Vertical);
+  }
+  else if (addr < 0xE000)
+  {
+    if (odd)
+    {
+      IRQCounter = 0;
+      IRQReload = true;
+    }
+    else
+    {
+      IRQLatch = val;
+    }
+  }
+  else
+  {
+    // Disabling also acknowledges a pending IRQ.
+    IRQEnabled = odd;
+    if (!odd)
+      irq_asserted = false;
+  }
+
+  return true;
+}
+
+void Mapper_004::updateBanks()
+{
+  // PPU $0000-$07FF (or $1000-$17FF): 2 KB switchable CHR banks, R0 and R1
+  // PPU $1000-$1FFF (or $0000-$0FFF): 1 KB switchable CHR banks, R2-R5
+  const u16 chr_inversion = (BankSelect & 0x80) ? 0x1000 : 0;
+  MapCHRMemory(0x0000 ^ chr_inversion, 0x800, 0x400 * (BankRegisters[0] & 0xFE));
+  MapCHRMemory(0x0800 ^ chr_inversion, 0x800, 0x400 * (BankRegisters[1] & 0xFE));
+  MapCHRMemory(0x1000 ^ chr_inversion, 0x400, 0x400 * BankRegisters[2]);
+  MapCHRMemory(0x1400 ^ chr_inversion, 0x400, 0x400 * BankRegisters[3]);
+  MapCHRMemory(0x1800 ^ chr_inversion, 0x400, 0x400 * BankRegisters[4]);
+  MapCHRMemory(0x1C00 ^ chr_inversion, 0x400, 0x400 * BankRegisters[5]);
+
+  // CPU $8000-$9FFF (or $C000-$DFFF): 8 KB switchable PRG ROM bank, R6
+  // CPU $A000-$BFFF: 8 KB switchable PRG ROM bank, R7
+  // CPU $C000-$DFFF (or $8000-$9FFF): 8 KB PRG ROM bank, fixed to the second-last bank
+  // CPU $E000-$FFFF: 8 KB PRG ROM bank, fixed to the last bank
+  const u32 last_bank = GetPRGROMSize() - 0x2000;
+  const u16 prg_swap = (BankSelect & 0x40) ? 0x4000 : 0;
+  MapPRGROM(0x8000 ^ prg_swap, 0x2000, 0x2000 * (BankRegisters[6] & 0x3F));
+  MapPRGROM(0xA000, 0x2000, 0x2000 * (BankRegisters[7] & 0x3F));
+  MapPRGROM(0xC000 ^ prg_swap, 0x2000, last_bank - 0x2000);
+  MapPRGROM(0xE000, 0x2000, last_bank);
+}
+
+void Mapper_004::ClockScanlineCounter(u32 clocks)
+{
+  if (!clocks)
+    return;
+
+  // Clocks until the counter is next left at 0: after a reload it counts down from the
+  // latch, and reloads every latch + 1 clocks from there on.
+  const bool reloading = IRQCounter == 0 || IRQReload;
+  const u32 until_zero = reloading ? IRQLatch + 1 : IRQCounter;
+  IRQReload = false;
+
+  if (clocks < until_zero)
+  {
+    IRQCounter = reloading ? IRQLatch - (clocks - 1) : IRQCounter - clocks;
+    return;
+  }
+
+  if (IRQEnabled)
+    irq_asserted = true;
+
+  const u32 after_zero = clocks - until_zero;
+  IRQCounter = after_zero ? IRQLatch - (after_zero - 1) % (IRQLatch + 1) : 0;
+}
+
+u32 Mapper_004::GetScanlineClocksUntilIRQ() const
+{
+  if (!IRQEnabled)
+    return 0;
+  return (IRQCounter == 0 || IRQReload) ? IRQLatch + 1 : IRQCounter;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "core/cartridge.h"
+
+class Mapper_004 : public Cartridge
+{
+private:
+
+  // $8000: which of the bank registers R0-R7 the next $8001 write goes to, and the PRG
+  // and CHR bank layouts
+  u8 BankSelect;
+  u8 BankRegisters[8];
+
+  // Scanline counter: reloaded from the latch on the clock after it reaches 0 (or after a
+  // $C001 write), and raising IRQ whenever a clock leaves it at 0 while enabled.
+  u8 IRQLatch;
+  u8 IRQCounter;
+  bool IRQReload;
+  bool IRQEnabled;
+
+  void updateBanks();
+
+public:
+  Mapper_004(CartridgeDescription description, const u8 *prg_rom, const u8 *chr_rom) noexcept;
+
+  bool CPUWrite(u16 addr, u8 val) final;
+
+  void ClockScanlineCounter(u32 clocks) final;
+  u32 GetScanlineClocksUntilIRQ() const final;
+};